@@ -226,7 +226,10 @@ void binostream::writeQWord(QWord dw)
 
 void binostream::writeFloat(Float f)
 {
-  writeDWord(*(DWord *)&f);
+  DWord dw = 0;
+
+  memcpy(&dw, &f, sizeof(f));	// DWord may be wider than Float
+  writeDWord(dw);
 }
 
 void binostream::writeDouble(Double d)
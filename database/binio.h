@@ -24,6 +24,7 @@
 #define H_BINIO
 
 #include <string>
+#include <iosfwd>
 
 class binio
 {
@@ -89,7 +90,7 @@ class binostream: virtual public binio
 {
 public:
   binostream();
-  binostream(ostream &stream);
+  binostream(std::ostream &stream);
 
   virtual ~binostream();
 
@@ -0,0 +1,328 @@
+// _________
+// Bench.cpp
+//
+// A small console program that measures the throughput of the OPL.hpp
+// classes and of the ymf262 emulator under various loads.
+//
+// Prints one CSV line per measurement to stdout, so that results of
+// different builds can be compared with diff or any spreadsheet:
+//
+//   test,mode,simd,waveform,operators,block,chips,rate,quality,
+//   samples_per_s,ns_per_sample
+//
+// A sample is one output frame of one chip. Every measurement runs for
+// at least the number of seconds given as the only (optional) argument,
+// 0.2 by default, and the best of three runs is reported.
+
+#include "OPL.hpp"
+#include "ymf262.h"
+#include "ymf262simd.h"
+#include "ymf262sched.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Native rate of the chip, no resampling
+static const int NATIVE = 49716;
+
+// Minimum time per run in seconds
+static double minTime = 0.2;
+
+static double Now()
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// ___
+// Job
+//
+// ABSTRACT: Something to measure. Run() renders a piece of audio and
+//   returns the number of samples it rendered.
+
+struct Job {
+
+	virtual ~Job() {
+	}
+
+	virtual double Run() = 0;
+};
+
+// Best samples per second of three runs of at least minTime each
+static double Measure(Job &job)
+{
+	double best = 0;
+
+	job.Run();	// warm up caches and branch predictors
+
+	for (int i=0;i<3;++i) {
+		double samples = 0, start = Now(), time;
+		do {
+			samples += job.Run();
+		} while ((time = Now() - start) < minTime);
+		if (samples / time > best) best = samples / time;
+	}
+
+	return best;
+}
+
+static void Report(const char *test, const char *mode, const char *simd,
+				   int waveform, int operators, int block, int chips,
+				   int rate, int quality, double perSecond)
+{
+	printf("%s,%s,%s,%d,%d,%d,%d,%d,%d,%.0f,%.3f\n", test, mode, simd,
+		   waveform, operators, block, chips, rate, quality, perSecond,
+		   1e9 / perSecond);
+	fflush(stdout);
+}
+
+// ______
+// OplJob
+//
+// ABSTRACT: 'voices' modulator/carrier pairs of the OPL.hpp classes,
+//   computed much like Test.cpp does, into a buffer of 'block' samples.
+//   Each operator has a Phasor of its own, as Operator needs.
+
+struct OplJob : Job {
+
+	OplJob(int voices, int waveform, int block)
+		: voices(voices), block(block), buffer(new short[block]) {
+		for (int v=0;v<voices;++v) {
+			ps1[v].omega = (1 << 23) + v * 8192;
+			ps2[v].omega = ps1[v].omega * 2;
+			ps1[v].phi = ps2[v].phi = 0;
+			wave1[v].type = wave2[v].type = waveform;
+			env1[v].dRate = env2[v].dRate = 24;	// stay audible
+			env1[v].KeyOn();
+			env2[v].KeyOn();
+		}
+	}
+
+	~OplJob() {
+		delete[] buffer;
+	}
+
+	double Run() {
+		for (int i=0;i<block;++i) {
+			long sum = 0;
+			for (int v=0;v<voices;++v) {
+				long mod = (wave1[v][ps1[v].Get()] * (env1[v].Get() >> 16));
+				sum += (wave2[v][ps2[v].Get() + mod] * (env2[v].Get() >> 16)) >> 16;
+			}
+			buffer[i] = short(sum);
+		}
+		return block;
+	}
+
+	int voices, block;
+	short *buffer;
+	Phasor ps1[18], ps2[18];
+	Waveform wave1[18], wave2[18];
+	ADSR env1[18], env2[18];
+};
+
+// ___________
+// OperatorJob
+//
+// ABSTRACT: The same as OplJob, rendered a block at a time through the
+//   templated Operator loops. The output is the same, which Check.cpp
+//   makes sure of.
+
+struct OperatorJob : Job {
+
+	OperatorJob(int voices, int waveform, int block)
+		: voices(voices), block(block), buffer(new short[block]),
+		  mod(new long[block]), car(new long[block]) {
+		for (int v=0;v<voices;++v) {
+			op1[v].phase.omega = (1 << 23) + v * 8192;
+			op2[v].phase.omega = op1[v].phase.omega * 2;
+			op1[v].phase.phi = op2[v].phase.phi = 0;
+			op1[v].wave.type = op2[v].wave.type = waveform;
+			op1[v].env.dRate = op2[v].env.dRate = 24;	// stay audible
+			op1[v].env.KeyOn();
+			op2[v].env.KeyOn();
+		}
+	}
+
+	~OperatorJob() {
+		delete[] buffer;
+		delete[] mod;
+		delete[] car;
+	}
+
+	double Run() {
+		for (int i=0;i<block;++i) buffer[i] = 0;
+		for (int v=0;v<voices;++v) {
+			op1[v].Render(mod, 0, block);
+			op2[v].Render(car, mod, block);
+			for (int i=0;i<block;++i) buffer[i] += short(car[i] >> 16);
+		}
+		return block;
+	}
+
+	int voices, block;
+	short *buffer;
+	long *mod, *car;
+	Operator op1[18], op2[18];
+};
+
+// Key on 'channels' channels of a chip, or of a lane of a batch, with
+// both operators sustaining forever on 'waveform'
+static void Program(YMF262 *opl, YMF262_BATCH *batch, uint32 lane,
+					int channels, int waveform)
+{
+	for (int c=0;c<channels;++c) {
+		uint8 set = c / 9, ch = c % 9, slot = (ch % 3) + (ch / 3) * 8;
+		const uint8 regs[][2] = {
+			{ uint8(0x20 + slot), 0x21 }, { uint8(0x23 + slot), 0x21 },
+			{ uint8(0x60 + slot), 0xf1 }, { uint8(0x63 + slot), 0xf1 },
+			{ uint8(0x80 + slot), 0x01 }, { uint8(0x83 + slot), 0x01 },
+			{ uint8(0xe0 + slot), uint8(waveform) },
+			{ uint8(0xe3 + slot), uint8(waveform) },
+			{ uint8(0xc0 + ch), 0x30 },
+			{ uint8(0xa0 + ch), uint8(0x40 + c * 7) },
+			{ uint8(0xb0 + ch), 0x31 }
+		};
+
+		for (unsigned i=0;i<sizeof(regs)/sizeof(regs[0]);++i)
+			if (batch)
+				ymf262_batch_write(batch, lane, set, regs[i][0], regs[i][1]);
+			else
+				ymf262_write(opl, set, regs[i][0], regs[i][1]);
+	}
+}
+
+// ________
+// ChipsJob
+//
+// ABSTRACT: 'count' chips rendering 'block' samples each, one after the
+//   other, on the thread pool of 'sched' or as one batch, with operators
+//   in 'pipeline'.
+
+struct ChipsJob : Job {
+
+	ChipsJob(int count, int channels, int waveform, int block, int rate,
+			 int quality, YMF262_SCHED *sched, bool batched,
+			 int pipeline = YMF262_PIPELINE_LINEAR)
+		: count(count), block(block), sched(sched), batch(0) {
+		if (batched) {
+			batch = ymf262_batch_create(count, 1, 16, rate);
+			ymf262_batch_set_quality(batch, quality);
+			ymf262_batch_set_pipeline(batch, pipeline);
+		}
+		for (int i=0;i<count;++i) {
+			chips[i] = 0;
+			if (!batch) {
+				chips[i] = ymf262_create(1, 16, rate);
+				ymf262_set_quality(chips[i], quality);
+				ymf262_set_pipeline(chips[i], pipeline);
+			}
+			Program(chips[i], batch, i, channels, waveform);
+			buffers[i] = new short[block];
+		}
+	}
+
+	~ChipsJob() {
+		for (int i=0;i<count;++i) {
+			if (!batch) ymf262_destroy(chips[i]);
+			delete[] (short *)buffers[i];
+		}
+		if (batch) ymf262_batch_destroy(batch);
+	}
+
+	double Run() {
+		if (batch)
+			ymf262_batch_render(batch, buffers, block * 2);
+		else if (sched)
+			ymf262_sched_render(sched, chips, buffers, count, block * 2, 0, 0);
+		else
+			for (int i=0;i<count;++i)
+				ymf262_render(chips[i], buffers[i], block * 2);
+		return double(block) * count;
+	}
+
+	int count, block;
+	YMF262_SCHED *sched;
+	YMF262_BATCH *batch;
+	YMF262 *chips[16];
+	void *buffers[16];
+};
+
+int main(int argc, char **argv)
+{
+	static const int channels[] = { 0, 1, 2, 4, 9, 18 };
+	static const int blocks[] = { 16, 64, 256, 1024, 4096 };
+	static const int rates[] = { 44100, 48000 };
+	static const int counts[] = { 1, 2, 4, 8, 16 };
+	static const int loads[] = { 2, 6, 18 };
+	const char *simd = ymf262_simd_select()->name;
+
+	if (argc > 1) minTime = atof(argv[1]);
+
+	printf("test,mode,simd,waveform,operators,block,chips,rate,quality,"
+		   "samples_per_s,ns_per_sample\n");
+
+	// OPL.hpp classes
+	for (int w=0;w<4;++w)
+		for (int v=1;v<=18;v+=v<9?8:9) {
+			OplJob job(v, w, 1024);
+			Report("oplhpp", "serial", "none", w, v * 2, 1024, 1, 0, 0,
+				   Measure(job));
+			OperatorJob ops(v, w, 1024);
+			Report("oplhpp", "template", "none", w, v * 2, 1024, 1, 0, 0,
+				   Measure(ops));
+		}
+
+	// one chip: active operators and waveforms
+	for (int w=0;w<4;++w)
+		for (unsigned c=0;c<sizeof(channels)/sizeof(channels[0]);++c) {
+			ChipsJob job(1, channels[c], w, 1024, NATIVE, 0, 0, false);
+			Report("render", "serial", simd, w, channels[c] * 2, 1024, 1,
+				   NATIVE, 0, Measure(job));
+			ChipsJob log(1, channels[c], w, 1024, NATIVE, 0, 0, false,
+						 YMF262_PIPELINE_LOG);
+			Report("render", "log", simd, w, channels[c] * 2, 1024, 1,
+				   NATIVE, 0, Measure(log));
+		}
+
+	// one chip: samples per ymf262_render() call
+	for (unsigned b=0;b<sizeof(blocks)/sizeof(blocks[0]);++b) {
+		ChipsJob job(1, 18, 0, blocks[b], NATIVE, 0, 0, false);
+		Report("block", "serial", simd, 0, 36, blocks[b], 1, NATIVE, 0,
+			   Measure(job));
+	}
+
+	// one chip: resampling
+	for (unsigned r=0;r<sizeof(rates)/sizeof(rates[0]);++r)
+		for (int q=YMF262_QUALITY_LOW;q<=YMF262_QUALITY_HIGH;++q) {
+			ChipsJob job(1, 18, 0, 1024, rates[r], q, 0, false);
+			Report("resample", "serial", simd, 0, 36, 1024, 1, rates[r], q,
+				   Measure(job));
+		}
+
+	// several chips: one by one, as a batch, on a pool. A batch is about
+	// twice as fast as one by one with 2 channels per chip, and about as
+	// fast from 6 on (see ymf262_batch_create()).
+	YMF262_SCHED *sched = ymf262_sched_create(0);
+	for (unsigned c=0;c<sizeof(loads)/sizeof(loads[0]);++c)
+		for (unsigned n=0;n<sizeof(counts)/sizeof(counts[0]);++n) {
+			int ops = loads[c] * 2;
+			ChipsJob serial(counts[n], loads[c], 0, 1024, NATIVE, 0, 0, false);
+			Report("chips", "serial", simd, 0, ops, 1024, counts[n], NATIVE, 0,
+				   Measure(serial));
+			ChipsJob batch(counts[n], loads[c], 0, 1024, NATIVE, 0, 0, true);
+			Report("chips", "batch", simd, 0, ops, 1024, counts[n], NATIVE, 0,
+				   Measure(batch));
+			if (sched) {
+				ChipsJob pool(counts[n], loads[c], 0, 1024, NATIVE, 0, sched,
+							  false);
+				Report("chips", "sched", simd, 0, ops, 1024, counts[n], NATIVE,
+					   0, Measure(pool));
+			}
+		}
+	if (sched) ymf262_sched_destroy(sched);
+
+	return 0;
+}
@@ -0,0 +1,913 @@
+// _________
+// Check.cpp
+//
+// A small console program that checks the ymf262 emulator against
+// itself: wherever two ways of rendering have to give the same output,
+// it renders the same register writes both ways and compares the bytes.
+//
+// Prints one line per check and returns 1 if any of them failed.
+
+#include "OPL.hpp"
+#include "ymf262.h"
+#include "ymf262simd.h"
+#include "ymf262sched.h"
+#include "ymf262pool.h"
+#include "ymf262out.h"
+#include "ymf262state.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// Native rate of the chip, no resampling
+static const uint32 NATIVE = 49716;
+
+// Checks that failed so far
+static int failed = 0;
+
+static void Report(const char *what, bool ok)
+{
+	printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+	fflush(stdout);
+	if (!ok) failed++;
+}
+
+// ______
+// Random
+//
+// ABSTRACT: Pseudo random numbers, the same on every platform
+
+struct Random {
+
+	uint32 Get() {
+		state = state * 1103515245 + 12345;
+		return state >> 16;
+	}
+
+	uint32 state;
+};
+
+// ____
+// Song
+//
+// ABSTRACT: Pseudo random register writes, a few at a time, with the
+//   number of samples to render between them. Every register the
+//   emulator knows about is written, key on included. It starts out in
+//   OPL3 mode, with deep tremolo and vibrato.
+
+struct Song {
+
+	Song(uint32 seed = 1) : start(0) {
+		rnd.state = seed;
+	}
+
+	// Next write, returns false if it is time to render instead
+	bool Next(uint8 &set, uint8 &index, uint8 &data) {
+		static const uint8 op[] = { 0x20, 0x60, 0x80, 0xe0 };
+		static const uint8 ch[] = { 0xa0, 0xb0, 0xc0 };
+		uint32 r;
+
+		switch (start++) {
+		case 0: set = 1; index = 0x05; data = 1; return true;
+		case 1: set = 0; index = 0xbd; data = 0xc0; return true;
+		}
+
+		r = rnd.Get();
+		if (r % 8 == 0) return false;
+		set = (r >> 3) & 1;
+		if (r & 16)
+			index = op[(r >> 5) & 3] + rnd.Get() % 0x16;
+		else
+			index = ch[(r >> 5) % 3] + rnd.Get() % 9;
+		data = uint8(rnd.Get());
+		return true;
+	}
+
+	// Samples to render before the next writes
+	uint32 Length() {
+		return 1 + rnd.Get() % 700;
+	}
+
+	Random rnd;
+	int start;
+};
+
+// Play 'samples' samples of a Song each on 'count' chips into 'buffers',
+// in frames of 'frame' bytes, all chips rendering the same pieces:
+// 'chips' one by one, the lanes of 'batch' if it is not NULL, or 'chips'
+// on the pool of 'sched' if that is not NULL. Returns the number of
+// pieces.
+static uint32 Play(YMF262 **chips, YMF262_BATCH *batch, uint32 count,
+				 uint8 **buffers, uint32 frame, uint32 samples,
+				 YMF262_SCHED *sched = 0, ymf262_done_fn done = 0,
+				 void *user = 0)
+{
+	uint32 n, pieces = 0;
+	uint8 set, index, data;
+	Song songs[16];
+	void *out[16];
+
+	for (uint32 c=0;c<count;++c) songs[c] = Song(c + 1);
+
+	for (uint32 pos=0;pos<samples;pos+=n,++pieces) {
+		for (uint32 c=0;c<count;++c)
+			while (songs[c].Next(set, index, data))
+				if (batch)
+					ymf262_batch_write(batch, c, set, index, data);
+				else
+					ymf262_write(chips[c], set, index, data);
+
+		n = songs[0].Length();
+		for (uint32 c=1;c<count;++c) songs[c].Length();
+		if (n > samples - pos) n = samples - pos;
+
+		for (uint32 c=0;c<count;++c) {
+			out[c] = buffers[c] + pos * frame;
+			if (!batch && !sched) ymf262_render(chips[c], out[c], n * frame);
+		}
+		if (batch) ymf262_batch_render(batch, out, n * frame);
+		if (sched)
+			ymf262_sched_render(sched, chips, out, count, n * frame, done,
+								user);
+	}
+
+	return pieces;
+}
+
+// Every kernel set renders what the plain C kernels do, in both
+// pipelines and every sample format, at the native rate and resampled
+static void CheckKernels()
+{
+	static const struct {
+		uint8 channels, bits;
+		uint32 rate;
+	} formats[] = {
+		{ 2, 16, NATIVE }, { 1, 8, 44100 }, { 4, 32, 48000 }, { 2, 24, NATIVE }
+	};
+	static const uint32 samples = 3 * NATIVE;
+	static uint8 want[samples * 4 * 4], got[samples * 4 * 4];
+	const struct YMF262_SIMD *simd;
+	char what[80];
+
+	for (uint8 pipeline=YMF262_PIPELINE_LINEAR;pipeline<=YMF262_PIPELINE_LOG;
+		 ++pipeline)
+		for (unsigned f=0;f<sizeof(formats)/sizeof(formats[0]);++f) {
+			uint32 bytes = samples * formats[f].channels * formats[f].bits / 8;
+
+			for (uint32 k=0;(simd = ymf262_simd_get(k));++k) {
+				YMF262 *opl = ymf262_create(formats[f].channels,
+											formats[f].bits, formats[f].rate);
+				opl->simd = simd;
+				ymf262_set_pipeline(opl, pipeline);
+				uint8 *buffer = k ? got : want;
+				Play(&opl, 0, 1, &buffer, bytes / samples, samples);
+				ymf262_destroy(opl);
+				if (!k) continue;
+
+				sprintf(what, "kernels %s, %s pipeline, %dx%d bit at %u Hz",
+						simd->name, pipeline ? "log" : "linear",
+						formats[f].channels, formats[f].bits, formats[f].rate);
+				Report(what, !memcmp(want, got, bytes));
+			}
+		}
+}
+
+// A batch renders what its chips do one by one, with any number of lanes
+static void CheckBatch()
+{
+	static const struct {
+		uint8 channels, bits;
+		uint32 rate;
+	} formats[] = {
+		{ 2, 16, NATIVE }, { 4, 16, 44100 }, { 1, 8, 48000 }
+	};
+	static const uint32 lanes[] = { 1, 3, 8 };
+	static const uint32 samples = 2 * NATIVE;
+	static uint8 want[8][samples * 4 * 2], got[8][samples * 4 * 2];
+	uint8 *wants[8], *gots[8];
+	YMF262 *chips[8];
+	char what[80];
+
+	for (uint32 c=0;c<8;++c) {
+		wants[c] = want[c];
+		gots[c] = got[c];
+	}
+
+	for (uint8 pipeline=YMF262_PIPELINE_LINEAR;pipeline<=YMF262_PIPELINE_LOG;
+		 ++pipeline)
+		for (unsigned f=0;f<sizeof(formats)/sizeof(formats[0]);++f)
+			for (unsigned l=0;l<sizeof(lanes)/sizeof(lanes[0]);++l) {
+				uint32 frame = formats[f].channels * formats[f].bits / 8;
+				YMF262_BATCH *batch = ymf262_batch_create(lanes[l],
+					formats[f].channels, formats[f].bits, formats[f].rate);
+				bool ok = true;
+
+				ymf262_batch_set_pipeline(batch, pipeline);
+				for (uint32 c=0;c<lanes[l];++c) {
+					chips[c] = ymf262_create(formats[f].channels,
+											 formats[f].bits, formats[f].rate);
+					ymf262_set_pipeline(chips[c], pipeline);
+				}
+
+				Play(chips, 0, lanes[l], wants, frame, samples);
+				Play(0, batch, lanes[l], gots, frame, samples);
+				for (uint32 c=0;c<lanes[l];++c) {
+					ok = ok && !memcmp(want[c], got[c], samples * frame);
+					ymf262_destroy(chips[c]);
+				}
+				ymf262_batch_destroy(batch);
+
+				sprintf(what, "batch of %u, %s pipeline, %dx%d bit at %u Hz",
+						lanes[l], pipeline ? "log" : "linear",
+						formats[f].channels, formats[f].bits, formats[f].rate);
+				Report(what, ok);
+			}
+}
+
+// _____
+// Calls
+//
+// ABSTRACT: Counts the calls of a ymf262_done_fn for each chip
+
+struct Calls {
+
+	static void Done(YMF262 *opl, void *, void *user) {
+		Calls &calls = *(Calls *)user;
+
+		for (int c=0;c<8;++c)
+			if (calls.chips[c] == opl) calls.count[c]++;
+	}
+
+	YMF262 *chips[8];
+	uint32 count[8];
+};
+
+// The scheduler renders what the chips render one by one, with more
+// chips than threads, and reports every chip done once per call
+static void CheckSched()
+{
+	static const struct {
+		uint8 channels, bits;
+		uint32 rate;
+	} formats[] = {
+		{ 2, 16, NATIVE }, { 1, 8, 44100 }
+	};
+	static const uint32 samples = NATIVE;
+	static uint8 want[8][samples * 2 * 2], got[8][samples * 2 * 2];
+	uint8 *wants[8], *gots[8];
+	YMF262 *chips[8];
+	YMF262_SCHED *sched = ymf262_sched_create(3);
+	char what[80];
+
+	for (uint32 c=0;c<8;++c) {
+		wants[c] = want[c];
+		gots[c] = got[c];
+	}
+
+	for (unsigned f=0;f<sizeof(formats)/sizeof(formats[0]);++f) {
+		uint32 frame = formats[f].channels * formats[f].bits / 8, pieces;
+		Calls done;
+		bool ok = sched != 0;
+
+		for (uint32 c=0;c<8;++c)
+			chips[c] = ymf262_create(formats[f].channels, formats[f].bits,
+									 formats[f].rate);
+		pieces = Play(chips, 0, 8, wants, frame, samples);
+		for (uint32 c=0;c<8;++c) {
+			ymf262_destroy(chips[c]);
+			done.chips[c] = chips[c] = ymf262_create(formats[f].channels,
+				formats[f].bits, formats[f].rate);
+			done.count[c] = 0;
+		}
+
+		if (sched) Play(chips, 0, 8, gots, frame, samples, sched,
+						Calls::Done, &done);
+		for (uint32 c=0;c<8;++c) {
+			ok = ok && !memcmp(want[c], got[c], samples * frame) &&
+				done.count[c] == pieces;
+			ymf262_destroy(chips[c]);
+		}
+
+		sprintf(what, "scheduler, 8 chips on 3 threads, %dx%d bit at %u Hz",
+				formats[f].channels, formats[f].bits, formats[f].rate);
+		Report(what, ok);
+	}
+
+	if (sched) ymf262_sched_destroy(sched);
+}
+
+// A pool hands out as many chips as it has room for and no more, hands
+// the last one given back out first, and its chips render what those of
+// ymf262_create() do
+static void CheckPool()
+{
+	static const uint32 samples = NATIVE / 2;
+	static uint8 want[samples * 4 * 4], got[samples * 4 * 4];
+	YMF262_POOL *pool = ymf262_pool_create(3);
+	YMF262 *chips[3], *opl;
+	uint8 *buffer;
+	bool ok = pool != 0;
+
+	if (!pool) {
+		Report("pool of 3", false);
+		return;
+	}
+
+	for (int c=0;c<3;++c) {
+		chips[c] = ymf262_pool_get(pool, 2, 16, NATIVE);
+		ok = ok && chips[c] && (!c || chips[c] != chips[c-1]);
+	}
+	Report("pool of 3, gives out 3 chips",
+		   ok && !ymf262_pool_get(pool, 2, 16, NATIVE));
+
+	// handed out again in another format
+	ymf262_pool_put(pool, chips[1]);
+	opl = ymf262_pool_get(pool, 4, 32, 48000);
+	Report("pool of 3, reuses a chip given back", opl && opl == chips[1]);
+
+	if (opl) {
+		buffer = got;
+		Play(&opl, 0, 1, &buffer, 16, samples);
+		opl = ymf262_create(4, 32, 48000);
+		buffer = want;
+		Play(&opl, 0, 1, &buffer, 16, samples);
+		ymf262_destroy(opl);
+		Report("pool of 3, renders as ymf262_create() does",
+			   !memcmp(want, got, samples * 16));
+	}
+
+	ymf262_pool_destroy(pool);
+}
+
+// ____
+// Feed
+//
+// ABSTRACT: A Song handed out by a ymf262_pull_fn, one write every 10
+//   output samples
+
+struct Feed {
+
+	Feed(uint32 time) : time(time), song(7) {
+	}
+
+	static uint8 Pull(void *user, uint32 end, YMF262_EVENT *ev) {
+		Feed &feed = *(Feed *)user;
+
+		if ((int32)(feed.time - end) >= 0) return 0;
+		while (!feed.song.Next(ev->set, ev->index, ev->data)) {
+		}
+		ev->time = feed.time;
+		feed.time += 10;
+		return 1;
+	}
+
+	uint32 time;
+	Song song;
+};
+
+// ymf262_skip() goes on exactly where rendering would, with more posted
+// or pulled writes due within the skip than the write queue holds
+static void CheckSkip()
+{
+	static const uint32 rates[] = { NATIVE, 44100 };
+	static const uint32 skips[] = { 5200, 6000, 20000 };
+	static const uint32 start = 1000, samples = 4096;
+	static int16 scratch[20000 * 2], want[samples * 2], got[samples * 2];
+	uint8 *buffer = (uint8 *)scratch;
+	uint8 set, index, data;
+	char what[80];
+
+	for (unsigned r=0;r<sizeof(rates)/sizeof(rates[0]);++r)
+		for (int pulled=0;pulled<2;++pulled)
+			for (unsigned k=0;k<sizeof(skips)/sizeof(skips[0]);++k) {
+				YMF262 *rendered = ymf262_create(2, 16, rates[r]);
+				YMF262 *skipped = ymf262_create(2, 16, rates[r]);
+				Feed feeds[2] = { Feed(start), Feed(start) };
+				Song song(7);
+
+				Play(&rendered, 0, 1, &buffer, 4, start);
+				Play(&skipped, 0, 1, &buffer, 4, start);
+				if (pulled) {
+					ymf262_set_pull(rendered, Feed::Pull, &feeds[0]);
+					ymf262_set_pull(skipped, Feed::Pull, &feeds[1]);
+				} else
+					for (uint32 t=start;t<start+skips[k] &&
+							 t<start+10*(YMF262_INBOX-1);t+=10) {
+						while (!song.Next(set, index, data)) {
+						}
+						ymf262_post(rendered, t, set, index, data);
+						ymf262_post(skipped, t, set, index, data);
+					}
+
+				ymf262_render(rendered, scratch, skips[k] * 4);
+				ymf262_skip(skipped, skips[k]);
+				ymf262_render(rendered, want, sizeof(want));
+				ymf262_render(skipped, got, sizeof(got));
+				ymf262_destroy(rendered);
+				ymf262_destroy(skipped);
+
+				sprintf(what, "skip of %u with %s writes at %u Hz", skips[k],
+						pulled ? "pulled" : "posted", rates[r]);
+				Report(what, !memcmp(want, got, sizeof(want)));
+			}
+}
+
+// ___
+// Irq
+//
+// ABSTRACT: Records at which native sample a chip called its IRQ
+//   callback, and resets the IRQ each time
+
+struct Irq {
+
+	Irq(YMF262 *opl) : opl(opl), reading(false), misplaced(false) {
+	}
+
+	static void Call(void *user, uint8) {
+		Irq &irq = *(Irq *)user;
+
+		irq.misplaced = irq.misplaced || irq.reading;
+		irq.clocks.push_back(irq.opl->clock);
+		ymf262_write(irq.opl, 0, 0x04, 0x80);
+	}
+
+	YMF262 *opl;
+	bool reading, misplaced;
+	std::vector<uint32> clocks;
+};
+
+// Render 'samples' more native samples of a mono 16 bit chip
+static void Run(YMF262 *opl, uint32 samples)
+{
+	static int16 buffer[4096];
+
+	while (samples) {
+		uint32 piece = samples < 4096 ? samples : 4096;
+
+		ymf262_render(opl, buffer, piece * 2);
+		samples -= piece;
+	}
+}
+
+// Status register after rendering 'samples' more native samples
+static uint8 StatusAfter(YMF262 *opl, uint32 samples)
+{
+	Run(opl, samples);
+	return ymf262_readstatus(opl);
+}
+
+// Timer 1 overflows every (256 - register) * 4 native samples and timer 2
+// every (256 - register) * 16, setting their status flags unless masked,
+// until an IRQ reset clears them
+static void CheckTimers()
+{
+	static const struct {
+		uint8 start, mask, flags;
+		uint32 period;
+	} timers[] = {
+		{ 0x01, 0x40, 0xc0, 25 * 4 }, { 0x02, 0x20, 0xa0, 25 * 16 }
+	};
+	char what[80];
+
+	for (int t=0;t<2;++t) {
+		YMF262 *opl = ymf262_create(1, 16, NATIVE);
+		uint32 period = timers[t].period;
+		bool ok = true;
+
+		ymf262_write(opl, 0, 0x02 + t, 256 - 25);
+		ymf262_write(opl, 0, 0x04, timers[t].start);
+		for (int i=0;i<4;++i) {
+			ok = ok && StatusAfter(opl, period - 1) == 0;
+			ok = ok && StatusAfter(opl, 1) == timers[t].flags;
+			ymf262_write(opl, 0, 0x04, 0x80);	// IRQ reset
+			ok = ok && ymf262_readstatus(opl) == 0;
+		}
+
+		// masked: it keeps running, but never sets its flag
+		ymf262_write(opl, 0, 0x04, timers[t].start | timers[t].mask);
+		ok = ok && StatusAfter(opl, 3 * period) == 0;
+		ymf262_destroy(opl);
+
+		sprintf(what, "timer %d, every %u samples", t + 1, period);
+		Report(what, ok);
+	}
+}
+
+// The IRQ callback is called at the same samples however the output is
+// cut into pieces, and never from ymf262_readstatus(), even when a timer
+// overflows right after the last sample rendered
+static void CheckIrq()
+{
+	static const uint32 pieces[] = { 1000, 100 };
+	static int16 buffer[1000];
+	YMF262 *chips[2];
+	Irq *irqs[2];
+
+	for (int c=0;c<2;++c) {
+		chips[c] = ymf262_create(1, 16, NATIVE);
+		irqs[c] = new Irq(chips[c]);
+		ymf262_set_irq(chips[c], Irq::Call, irqs[c]);
+		ymf262_write(chips[c], 0, 0x02, 256 - 25);	// every 100 samples
+		ymf262_write(chips[c], 0, 0x04, 0x01);
+
+		for (uint32 pos=0;pos<10000;pos+=pieces[c]) {
+			ymf262_render(chips[c], buffer, pieces[c] * 2);
+			irqs[c]->reading = true;
+			ymf262_readstatus(chips[c]);
+			irqs[c]->reading = false;
+		}
+	}
+
+	bool ok = irqs[0]->clocks == irqs[1]->clocks && irqs[0]->clocks.size() &&
+		!irqs[0]->misplaced && !irqs[1]->misplaced;
+	for (uint32 i=0;i<irqs[0]->clocks.size();++i)
+		ok = ok && irqs[0]->clocks[i] == (i + 1) * 100;
+	Report("IRQ callback, not from ymf262_readstatus()", ok);
+
+	for (int c=0;c<2;++c) {
+		ymf262_destroy(chips[c]);
+		delete irqs[c];
+	}
+}
+
+// Attack and decay take known numbers of native samples for their rate,
+// 4 * AR or DR plus the key scale: block * 2 + fnum bit 9 with KSR set,
+// (block * 2 + fnum bit 9) / 4 without.  Each step of 4 halves the time,
+// as in the datasheet's tables (an attack at rate 32 near 2826 ms / 128).
+// Rate 15 attacks at once and a rate of 0 never moves.
+static void CheckEnvelope()
+{
+	static const struct {
+		uint8 ar, dr, ksr, block, state;
+		uint32 samples;
+		const char *what;
+	} rates[] = {
+		{ 15, 0, 0, 0, YMF262_EG_ATTACK, 1, "attack, AR 15" },
+		{ 12, 0, 0, 0, YMF262_EG_ATTACK, 70, "attack, AR 12" },
+		{ 8, 0, 0, 0, YMF262_EG_ATTACK, 1105, "attack, AR 8" },
+		{ 15, 1, 0, 0, YMF262_EG_DECAY, 2029569, "decay, DR 1" },
+		{ 15, 1, 0, 7, YMF262_EG_DECAY, 1159169, "decay, DR 1, block 7" },
+		{ 15, 1, 1, 7, YMF262_EG_DECAY, 144897,
+			"decay, DR 1, block 7, KSR" },
+		{ 0, 0, 0, 7, YMF262_EG_ATTACK, 0, "attack, AR 0" },
+		{ 15, 0, 1, 7, YMF262_EG_DECAY, 0, "decay, DR 0" }
+	};
+	char what[80];
+
+	for (unsigned r=0;r<sizeof(rates)/sizeof(rates[0]);++r) {
+		YMF262 *opl = ymf262_create(1, 16, NATIVE);
+		uint8 state = rates[r].state;
+		uint32 samples = rates[r].samples;
+		bool ok;
+
+		// modulator of channel 0: sustaining, down to SL 15, fnum 0x200
+		ymf262_write(opl, 0, 0x20, 0x21 | rates[r].ksr << 4);
+		ymf262_write(opl, 0, 0x60, rates[r].ar << 4 | rates[r].dr);
+		ymf262_write(opl, 0, 0x80, 0xf0);
+		ymf262_write(opl, 0, 0xa0, 0x00);
+		ymf262_write(opl, 0, 0xb0, 0x22 | rates[r].block << 2);
+
+		if (samples) {
+			// the decays start from an attack that ends at once
+			Run(opl, samples - 1);
+			ok = opl->op.env_state[0] == state;
+			Run(opl, 1);
+			ok = ok && opl->op.env_state[0] == state + 1u;
+			sprintf(what, "%s, %u samples", rates[r].what, samples);
+		} else {
+			Run(opl, 100000);
+			ok = opl->op.env_state[0] == state && opl->op.env_att[0] ==
+				(state == YMF262_EG_ATTACK ? YMF262_EG_MAX : 0u);
+			sprintf(what, "%s, never", rates[r].what);
+		}
+		ymf262_destroy(opl);
+		Report(what, ok);
+	}
+}
+
+// ___
+// Ack
+//
+// ABSTRACT: Counts the IRQ callbacks of a batch lane, and resets the IRQ
+//   each time, with the same value written to 0x04 over and over
+
+struct Ack {
+
+	static void Call(void *user, uint8) {
+		Ack &ack = *(Ack *)user;
+
+		ack.calls++;
+		ymf262_batch_write(ack.batch, 0, 0, 0x04, 0x80);
+	}
+
+	YMF262_BATCH *batch;
+	uint32 calls;
+};
+
+// Writes of the value a register holds are dropped, so rewriting 0xb0
+// with the key still on leaves the envelope alone; writes to 0x04 are
+// commands, and none of them is ever dropped
+static void CheckWrites()
+{
+	static int16 buffer[1000];
+	void *buffers[1] = { buffer };
+	YMF262 *opl = ymf262_create(1, 16, NATIVE);
+	uint32 att;
+	bool ok;
+
+	// modulator of channel 0: instant attack, then a slow decay
+	ymf262_write(opl, 0, 0x20, 0x21);
+	ymf262_write(opl, 0, 0x60, 0xf4);
+	ymf262_write(opl, 0, 0x80, 0xf0);
+	ymf262_write(opl, 0, 0xb0, 0x22);
+	Run(opl, 20000);
+	att = opl->op.env_att[0];
+
+	ymf262_write(opl, 0, 0xb0, 0x22);
+	ok = opl->op.env_state[0] == YMF262_EG_DECAY && opl->op.env_att[0] == att;
+	ymf262_write(opl, 0, 0xb0, 0x3e);	// another block and F-number
+	ymf262_write(opl, 0, 0xa0, 0x80);
+	Run(opl, 1);
+	ok = ok && att && opl->op.env_state[0] == YMF262_EG_DECAY &&
+		opl->op.env_att[0] >= att;
+	ymf262_destroy(opl);
+	Report("0xb0 rewritten with the key on, no new attack", ok);
+
+	YMF262_BATCH *batch = ymf262_batch_create(1, 1, 16, NATIVE);
+	Ack ack = { batch, 0 };
+
+	ymf262_batch_set_irq(batch, 0, Ack::Call, &ack);
+	ymf262_batch_write(batch, 0, 0, 0x02, 256 - 25);	// every 100 samples
+	ymf262_batch_write(batch, 0, 0, 0x04, 0x01);
+	ymf262_batch_render(batch, buffers, sizeof(buffer));	// IRQ at 100 - 900
+	ymf262_batch_destroy(batch);
+	Report("0x04 written again, IRQ every 100 samples", ack.calls == 9);
+}
+
+// Little endian number of 'bytes' bytes at 'p'
+static uint32 Le(const uint8 *p, int bytes)
+{
+	uint32 value = 0;
+
+	while (bytes--) value = value << 8 | p[bytes];
+	return value;
+}
+
+// WAV files from the writer have the right chunk sizes and format fields
+// for every sample format, written to a buffer or mapped, with an odd
+// number of data bytes where the format allows
+static void CheckWav()
+{
+	static const struct {
+		uint8 channels, bits;
+	} formats[] = {
+		{ 1, 8 }, { 2, 16 }, { 1, 24 }, { 2, 32 }, { 4, 16 }
+	};
+	static const uint32 samples = 1001, rate = 44100;
+	static const char *name = "Check.wav";
+	static uint8 file[80 + samples * 8 + 1];
+	char what[80];
+
+	for (unsigned f=0;f<sizeof(formats)/sizeof(formats[0]);++f)
+		for (int mapped=0;mapped<2;++mapped) {
+			uint8 channels = formats[f].channels, bits = formats[f].bits;
+			uint32 frame = channels * bits / 8, data = samples * frame, size;
+			bool ext = bits > 16 || channels > 2, ok;
+			const uint8 *p = file + 12;
+			YMF262 *opl = ymf262_create(channels, bits, rate);
+			YMF262_OUT *out = ymf262_out_open(opl, name, YMF262_OUT_WAV |
+				(mapped ? YMF262_OUT_MMAP : 0), 4096);
+			FILE *in;
+
+			ok = out && ymf262_out_render(out, samples) &&
+				ymf262_out_close(out);
+			ymf262_destroy(opl);
+			in = ok ? fopen(name, "rb") : 0;
+			size = in ? fread(file, 1, sizeof(file), in) : 0;
+			if (in) fclose(in);
+			remove(name);
+
+			// RIFF, fmt, fact for float, data and a pad byte if odd
+			ok = size > 44 && !memcmp(file, "RIFF", 4) &&
+				Le(file + 4, 4) == size - 8 && !memcmp(file + 8, "WAVE", 4) &&
+				!memcmp(p, "fmt ", 4) && Le(p + 4, 4) == (ext ? 40u : 16u) &&
+				Le(p + 8, 2) == (ext ? 0xfffeu : 1u) &&
+				Le(p + 10, 2) == channels && Le(p + 12, 4) == rate &&
+				Le(p + 16, 4) == rate * frame && Le(p + 20, 2) == frame &&
+				Le(p + 22, 2) == bits;
+			if (ok && ext) {
+				ok = Le(p + 24, 2) == 22 && Le(p + 26, 2) == bits &&
+					Le(p + 28, 4) == (channels == 4 ? 0x33u :
+									  channels == 2 ? 0x03u : 0x04u) &&
+					Le(p + 32, 2) == (bits == 32 ? 3u : 1u);
+			}
+			if (ok) p += 8 + Le(p + 4, 4);
+			if (ok && bits == 32) {
+				ok = !memcmp(p, "fact", 4) && Le(p + 4, 4) == 4 &&
+					Le(p + 8, 4) == samples;
+				p += 12;
+			}
+			ok = ok && !memcmp(p, "data", 4) && Le(p + 4, 4) == data &&
+				size == uint32(p + 8 - file) + data + (data & 1);
+
+			sprintf(what, "WAV file, %s, %dx%d bit",
+					mapped ? "mapped" : "buffered", channels, bits);
+			Report(what, ok);
+		}
+}
+
+// ______
+// Memory
+//
+// ABSTRACT: A binio stream that keeps what is written to it in memory,
+//   to be read back from the start
+
+struct Memory : public binstream {
+
+	Memory() : pos(0) {
+	}
+
+	bool eof() {
+		return pos > data.size();
+	}
+
+	void seek(unsigned long offset, Offset) {
+		pos = offset;
+	}
+
+	void write(const void *buf, unsigned long size) {
+		data.insert(data.end(), (const Byte *)buf, (const Byte *)buf + size);
+	}
+
+	unsigned long pos;
+	std::vector<Byte> data;
+
+private:
+	unsigned long read(void *buf, unsigned long size) {
+		unsigned long i;
+
+		for (i=0;i<size && !eof();++i) ((Byte *)buf)[i] = getByte();
+		return i;
+	}
+
+protected:
+	Byte getByte() {
+		if (pos >= data.size()) {	// reading past the end sets eof()
+			pos = data.size() + 1;
+			return 0;
+		}
+		return data[pos++];
+	}
+
+	void putByte(Byte b) {
+		data.push_back(b);
+	}
+};
+
+// A chip loaded from a snapshot renders what the saved one goes on to
+// render, with writes queued by ymf262_write_at() in the snapshot and
+// posted ones not
+static void CheckState()
+{
+	static const uint32 rates[] = { NATIVE, 44100, 48000 };
+	static const uint32 samples = NATIVE;
+	static int16 want[samples * 2], got[samples * 2];
+	uint8 *buffer = (uint8 *)want;
+	char what[80];
+
+	for (unsigned r=0;r<sizeof(rates)/sizeof(rates[0]);++r) {
+		YMF262 *saved = ymf262_create(2, 16, rates[r]);
+		YMF262 *loaded = ymf262_create(2, 16, rates[r]);
+		Memory snapshot;
+		bool ok;
+
+		ymf262_set_quality(saved, YMF262_QUALITY_HIGH);
+		ymf262_set_quality(loaded, YMF262_QUALITY_HIGH);
+		Play(&saved, 0, 1, &buffer, 4, samples);
+		ymf262_write_at(saved, 300, 0, 0xb0, 0x11);
+		ymf262_post(saved, samples + 700, 0, 0xb1, 0x0d);
+		ymf262_post(loaded, samples + 700, 0, 0xb1, 0x0d);
+
+		ok = ymf262_save_state(saved, snapshot) &&
+			ymf262_load_state(loaded, snapshot);
+		ymf262_render(saved, want, sizeof(want));
+		ymf262_render(loaded, got, sizeof(got));
+		ok = ok && !memcmp(want, got, sizeof(want));
+		ymf262_destroy(saved);
+		ymf262_destroy(loaded);
+
+		sprintf(what, "state snapshot at %u Hz", rates[r]);
+		Report(what, ok);
+	}
+}
+
+// A damaged snapshot does not load: queued writes to a register set that
+// does not exist, or due long before the clock, and running timers due
+// long before it
+static void CheckDamage()
+{
+	static const char *damages[] = { "none", "register set", "write time",
+									  "timer time" };
+	Memory snapshot;
+	YMF262 *opl = ymf262_create(2, 16, NATIVE);
+	uint32 write, top;
+
+	ymf262_write(opl, 0, 0x02, 0x80);		// timer 1 running
+	ymf262_write(opl, 0, 0x04, 0x01);
+	ymf262_write_at(opl, 300, 0, 0xb0, 0x11);
+	ymf262_save_state(opl, snapshot);
+	ymf262_destroy(opl);
+
+	// the queued write is set 0, 0xb0, 0x11 after its time, the timers
+	// come before the number of queued writes
+	for (write=4;write+7<snapshot.data.size();++write)
+		if (!snapshot.data[write+4] &&
+			snapshot.data[write+5] == binio::Byte(0xb0) &&
+			snapshot.data[write+6] == 0x11)
+			break;
+	top = snapshot.get_flag(binio::BigEndian) ? 0 : 3;
+
+	for (unsigned d=0;d<sizeof(damages)/sizeof(damages[0]);++d) {
+		Memory damaged;
+		char what[80];
+
+		damaged.data = snapshot.data;
+		switch (d) {
+		case 1: damaged.data[write + 4] = 2; break;
+		case 2: damaged.data[write + top] ^= 0x80; break;
+		case 3: damaged.data[write - 10 + top] ^= 0x80; break;
+		}
+
+		opl = ymf262_create(2, 16, NATIVE);
+		sprintf(what, "state snapshot, damaged: %s", damages[d]);
+		Report(what, ymf262_load_state(opl, damaged) == !d);
+		ymf262_destroy(opl);
+	}
+}
+
+// Operator::Render() gives what the OPL.hpp classes give sample by
+// sample, for every waveform and through attack, decay and release
+static void CheckOperator()
+{
+	static const int block = 1000;
+	long mod[block], car[block];
+	char what[80];
+
+	for (int w=0;w<4;++w) {
+		Phasor ps1, ps2;
+		Waveform wave1, wave2;
+		ADSR env1, env2;
+		Operator op1, op2;
+		bool ok = true;
+
+		// a voice as in Bench.cpp, with rates that take a few blocks
+		ps1.omega = op1.phase.omega = (1 << 23) + w * 8192;
+		ps2.omega = op2.phase.omega = ps1.omega * 2;
+		ps1.phi = ps2.phi = op1.phase.phi = op2.phase.phi = 0;
+		wave1.type = wave2.type = op1.wave.type = op2.wave.type = w;
+		env1.aRate = env2.aRate = op1.env.aRate = op2.env.aRate = 9;
+		env1.dRate = env2.dRate = op1.env.dRate = op2.env.dRate = 13;
+		env1.rRate = env2.rRate = op1.env.rRate = op2.env.rRate = 12;
+		env1.susLevel = env2.susLevel = op1.env.susLevel =
+			op2.env.susLevel = 0x40000000;
+
+		for (int b=0;b<40;++b) {
+			if (b == 0) {
+				env1.KeyOn(); env2.KeyOn(); op1.env.KeyOn(); op2.env.KeyOn();
+			} else if (b == 25) {
+				env1.KeyOff(); env2.KeyOff();
+				op1.env.KeyOff(); op2.env.KeyOff();
+			}
+
+			op1.Render(mod, 0, block);
+			op2.Render(car, mod, block);
+			for (int i=0;i<block;++i) {
+				long m = wave1[ps1.Get()] * (env1.Get() >> 16);
+				long c = wave2[ps2.Get() + m] * (env2.Get() >> 16);
+				ok = ok && m == mod[i] && c == car[i];
+			}
+		}
+
+		sprintf(what, "Operator::Render(), waveform %d", w);
+		Report(what, ok);
+	}
+}
+
+int main()
+{
+	CheckKernels();
+	CheckBatch();
+	CheckSched();
+	CheckPool();
+	CheckSkip();
+	CheckWav();
+	CheckTimers();
+	CheckIrq();
+	CheckEnvelope();
+	CheckWrites();
+	CheckState();
+	CheckDamage();
+	CheckOperator();
+
+	return failed ? 1 : 0;
+}
@@ -27,7 +27,7 @@ struct Phasor {
 	long omega;
 };
 
-#include <cmath>
+#include "ymf262tab.h"
 
 // _________
 // SineTable
@@ -35,24 +35,17 @@ struct Phasor {
 // ABSTRACT: A table of the first quarter of a sine wave
 //   Supports normalised phase readout
 // 
-// 512 real entries, 2048 effectively - to my knowledge what OPL2 has also
+// 512 real entries, 2048 effectively - to my knowledge what OPL2 has also.
+// The entries are generated at build time (see mktables.c), so there is
+// nothing to initialise.
 
 struct SineTable {
 
-	SineTable() {
-		for (ulong i=0;i<512;++i)
-			sine[i] = short(32767.0*sin(i/1024.0 * 3.141592653));
+	short operator [] (long phi) const {
+		long mirror = -((phi >> 30) & 1);	// symmetry to 90 and 270 dgs
+		return opl_sine[((phi >> 21) ^ mirror) & 511];	// map to 512 entries
 	}
-
-	short operator [] (long phi) {
-		if (phi & 0x40000000) 
-			phi ^= 0x3FFFFFFF;				// symmetry to 90 and 270 dgs
-
-		return sine[(phi >> 21) & 511];		// map to 512 entries
-	}
-
-	short sine[512];
-} stab; // one global instance
+} const stab = SineTable(); // one global instance
 
 // ________
 // Waveform
@@ -68,11 +61,13 @@ struct SineTable {
 struct Waveform {
 	
 	short operator [] (long phi) {
-		short y = stab[phi];  // use sine table
+		long y = stab[phi];  // use sine table
 
-		// use upper two bits to mangle waveform
-		if (type == 3 && phi & 0x40000000) y = 0;
-		return (phi & 0x80000000) ? ((type & 1) ? 0 : ((type & 2) ? y : -y)) : y;
+		// use upper two bits to mangle waveform, without branches
+		long q3 = -((phi >> 31) & 1), q2 = -((phi >> 30) & 1);
+		long neg = q3 & -long(type == 0);
+		long zero = (q3 & -long(type & 1)) | (q2 & -long(type == 3));
+		return short(((y ^ neg) - neg) & ~zero);
 	}
 
 	ulong type;			// 0, 1, 2, 3
@@ -101,6 +96,28 @@ struct Decay {
 		return !(level >> 8);	// OPL has only 24(?) bits so "quite zero" is OK
 	}
 
+	// Same as n calls to Get(), but stops early after the call that leaves
+	// level below 'stop'. As long as level >> shift stays the same, every
+	// call takes off the same amount, so those are done in one stride.
+	// Returns the number of calls done.
+	ulong Skip(ulong n, ulong stop = 0) {
+		ulong done = 0;
+		while (done < n) {
+			ulong d = level >> shift;
+			if (level - d < stop) {			// below 'stop' with the next one
+				level -= d;
+				return done + 1;
+			}
+			if (!d) return n;				// never moves again
+			ulong t = (level - (d << shift)) / d + 1;	// until level >> shift drops
+			if (stop && t > (level - stop) / d) t = (level - stop) / d;
+			if (t > n - done) t = n - done;
+			level -= t * d;
+			done += t;
+		}
+		return done;
+	}
+
 	ulong	level;				// current level
 	ulong	shift;				// 0..15 = half-life time
 };
@@ -154,8 +171,115 @@ struct ADSR {
 		return level + bias;				// no attack: level goes down
 	}	
 
+	// Same as n calls to Get(), in strides (see Decay::Skip())
+	void Skip(ulong n) {
+		while (n) {
+			if (!attack) {
+				env.Skip(n);
+				return;
+			}
+			n -= env.Skip(n, 256);			// stop where Finished() would
+			if (env.Finished()) {			// time to go from attack to decay
+				attack = false;
+				bias = susLevel;
+				env.level = ~susLevel;
+				env.shift = dRate;
+			}
+		}
+	}
+
 	bool attack;
 	Decay env;
 	ulong bias;
 };
 
+
+// ________
+// Operator
+//
+// ABSTRACT: Phasor, waveform and envelope of one operator, rendered a
+//   block at a time
+//
+// USAGE: Set up the members as for the single classes, then call
+//   Render(). Output samples are Waveform[] * (ADSR::Get() >> 16), the
+//   same as computing them one by one.
+//
+// Render() picks one of the inner loops below by waveform type and
+// envelope phase, and only goes back to pick another one when the
+// attack phase ends. Inside a loop all control flow is known at compile
+// time: no per-sample test of the type, of 'attack' or of 'pm'.
+
+struct Operator {
+
+	// Render 'n' samples into 'out'. 'pm' adds to the phase of each
+	// sample (phase modulation) unless it is 0.
+	void Render(long *out, const long *pm, int n);
+
+	Phasor phase;
+	Waveform wave;
+	ADSR env;
+};
+
+// Waveform::operator[] for a waveform type known at compile time
+template <ulong type>
+inline short WaveOf(long phi)
+{
+	long y = stab[phi];
+
+	long q3 = -((phi >> 31) & 1), q2 = -((phi >> 30) & 1);
+	long neg = type == 0 ? q3 : 0;
+	long zero = (type & 1 ? q3 : 0) | (type == 3 ? q2 : 0);
+	return short(((y ^ neg) - neg) & ~zero);
+}
+
+// Inner loop of Operator::Render(): returns the number of samples done,
+// less than 'n' if the attack phase ended
+template <ulong type, bool attack, bool modulated>
+int OperatorLoop(Operator &op, long *out, const long *pm, int n)
+{
+	Decay &env = op.env.env;
+	long phi = op.phase.phi, omega = op.phase.omega;
+
+	for (int i=0;i<n;++i) {
+		phi += omega;
+		ulong level = env.Get();
+		long y = WaveOf<type>(modulated ? phi + pm[i] : phi);
+
+		if (attack) {
+			out[i] = y * (~level >> 16);
+			if (env.Finished()) {			// time to go from attack to decay
+				op.env.attack = false;
+				op.env.bias = op.env.susLevel;
+				env.level = ~op.env.susLevel;
+				env.shift = op.env.dRate;
+				op.phase.phi = phi;
+				return i + 1;
+			}
+		} else
+			out[i] = y * ((level + op.env.bias) >> 16);
+	}
+
+	op.phase.phi = phi;
+	return n;
+}
+
+inline void Operator::Render(long *out, const long *pm, int n)
+{
+	typedef int (*Loop)(Operator &, long *, const long *, int);
+
+	// [type][attack][modulated]
+	static const Loop loops[4][2][2] = {
+		{ { OperatorLoop<0, false, false>, OperatorLoop<0, false, true> },
+		  { OperatorLoop<0, true, false>, OperatorLoop<0, true, true> } },
+		{ { OperatorLoop<1, false, false>, OperatorLoop<1, false, true> },
+		  { OperatorLoop<1, true, false>, OperatorLoop<1, true, true> } },
+		{ { OperatorLoop<2, false, false>, OperatorLoop<2, false, true> },
+		  { OperatorLoop<2, true, false>, OperatorLoop<2, true, true> } },
+		{ { OperatorLoop<3, false, false>, OperatorLoop<3, false, true> },
+		  { OperatorLoop<3, true, false>, OperatorLoop<3, true, true> } }
+	};
+
+	for (int i=0;i<n;)
+		i += loops[wave.type & 3][env.attack][pm != 0]
+			(*this, out + i, pm ? pm + i : 0, n - i);
+}
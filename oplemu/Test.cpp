@@ -38,6 +38,9 @@ int main()
 
 	FILE *out = fopen("opl-test.pcm", "wb+");
 
+	// One second at a time, written with a single call
+	static short buffer[44100];
+
 	for (int j=0;j<2;++j) {
 		if (j) {
 			env1.KeyOff(); 
@@ -48,9 +51,9 @@ int main()
 		}
 		for (int i=0;i<44100;++i) {	
 			long mod = (wave1[ps.Get()] * (env1.Get() >> 16));
-			short car = (wave2[ps.Get()*2 + mod] * (env2.Get() >> 16)) >> 16;
-			fwrite(&car, 2, 1, out);
+			buffer[i] = (wave2[ps.Get()*2 + mod] * (env2.Get() >> 16)) >> 16;
 		}
+		fwrite(buffer, 2, 44100, out);
 	}
 
 	fclose(out);
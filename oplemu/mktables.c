@@ -0,0 +1,157 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - lookup table generator
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * Writes ymf262tab.h to stdout, which holds every lookup table of the
+ * emulator as a static const array. That way the tables cost nothing at
+ * startup, need no locking and end up in read-only memory that all
+ * processes using the library share. The generated file is kept in the
+ * repository for builds that cannot run this program.
+ *
+ * Only plain C types are used in the output, so that OPL.hpp can include
+ * it without ymf262.h.
+ */
+
+#include <stdio.h>
+#include <math.h>
+
+/***** Defines *****/
+
+/* pi */
+#define PI	3.141592653
+
+/***** Global variables *****/
+
+/* digits per entry of the current table */
+static int width;
+
+/*
+ * Envelope increments of 8 updates in a row: rates 1 - 12 by the low 2
+ * bits of the rate, then rates 13 and 14 by them
+ */
+static const char eg_pattern[12][9] = {
+  "01010101", "01011101", "01110111", "01111111",
+  "11111111", "11121112", "12121212", "12221222",
+  "22222222", "22242224", "24242424", "24442444"
+};
+
+/***** Implementation *****/
+
+static void table_begin(const char *comment, const char *decl, int digits)
+{
+  printf("\n/* %s */\nstatic const %s = {", comment, decl);
+  width = digits;
+}
+
+static void table_entry(long value, unsigned long i)
+/* Print the 'i'th entry of the current table, as many as fit on a line. */
+{
+  printf("%s%s%*ld", i ? "," : "", (i % (56 / (width + 1))) ? "" : "\n ",
+	 width, value);
+}
+
+static void table_end(void)
+{
+  printf("\n};\n");
+}
+
+int main(void)
+{
+  unsigned long	i, j;
+  long		range;
+
+  printf("/* Generated by mktables.c - do not edit. */\n\n"
+	 "#ifndef H_YMF262TAB\n#define H_YMF262TAB\n");
+
+  /* The first quarter of a sine wave, padded for 32 bit gathers */
+  table_begin("first quarter of a sine wave, 1 entry padding",
+	      "short opl_sine[512 + 1]", 6);
+  for(i = 0; i < 512; i++)
+    table_entry((short)(32767.0 * sin(i / 1024.0 * PI)), i);
+  table_entry(0, i);
+  table_end();
+
+  /* Log-sin ROM of the real chip: -log2(sin) in 1/256 steps */
+  table_begin("quarter wave -log2(sin(x)), 8.8 fixed point, 1 entry padding",
+	      "unsigned short opl_logsin[256 + 1]", 6);
+  for(i = 0; i < 256; i++)
+    table_entry((long)floor(-log(sin((i + 0.5) * PI / 512.0)) / log(2.0)
+			    * 256.0 + 0.5), i);
+  table_entry(0, i);
+  table_end();
+
+  /* Exp ROM of the real chip: 2^x for the fractional part of an attenuation */
+  table_begin("2^((255 - x) / 256), scaled by 1024, 1 entry padding",
+	      "unsigned short opl_exp[256 + 1]", 6);
+  for(i = 0; i < 256; i++)
+    table_entry((long)floor(pow(2.0, (255 - i) / 256.0) * 1024.0 + 0.5), i);
+  table_entry(0, i);
+  table_end();
+
+  /* Sustain levels: 3 dB steps of 16 units of 0.1875 dB, 15 is 93 dB */
+  table_begin("4 bit register sustain level -> envelope attenuation",
+	      "unsigned short opl_sustain[16]", 6);
+  for(i = 0; i < 16; i++)
+    table_entry((i < 15 ? i : 31) << 4, i);
+  table_end();
+
+  /* Envelope rates: 4 * register rate + key scale offset, 0 - 63 */
+  table_begin("envelope rate -> log2 of the samples between two updates",
+	      "unsigned char opl_eg_shift[64]", 3);
+  for(i = 0; i < 64; i++)
+    table_entry(i < 52 ? 12 - (i >> 2) : 0, i);
+  table_end();
+
+  /* Attenuation steps of 8 updates in a row, the real chip's patterns */
+  table_begin("envelope rate -> increments [rate * 8 + (update & 7)]",
+	      "unsigned char opl_eg_inc[64 * 8]", 2);
+  for(i = 0; i < 64; i++)
+    for(j = 0; j < 8; j++)
+      table_entry(i < 4 ? 0 : i < 52 ? eg_pattern[i & 3][j] - '0' :
+		  i < 60 ? eg_pattern[i - 48][j] - '0' : 4, i * 8 + j);
+  table_end();
+
+  /* Envelope attenuation to level: this for the low 5 bits, then shifts */
+  table_begin("2^(-x / 32) for the low 5 bits of an envelope attenuation, "
+	      "scaled by 2^32", "unsigned int opl_eg_level[32]", 11);
+  for(i = 0; i < 32; i++)
+    table_entry(i ? (long)floor(4294967296.0 * pow(2.0, i / -32.0) + 0.5) :
+		4294967295, i);
+  table_end();
+
+  /* Tremolo: triangle of 0 - 26 (4.8 dB) over 210 LFO steps */
+  table_begin("tremolo attenuation per LFO step, 0.1875 dB units",
+	      "unsigned char opl_tremolo[210]", 6);
+  for(i = 0; i < 210; i++)
+    table_entry((i < 105 ? i : 210 - i) >> 2, i);
+  table_end();
+
+  /* Vibrato: F-number offset per LFO step and top 3 bits of F-number */
+  table_begin("vibrato F-number offset [LFO step * 8 + (F-number >> 7)]",
+	      "signed char opl_vibrato[8 * 8]", 6);
+  for(i = 0; i < 8; i++)
+    for(j = 0; j < 8; j++) {
+      range = (i & 3) ? ((i & 1) ? j >> 1 : j) : 0;
+      table_entry((i & 4) ? -range : range, i * 8 + j);
+    }
+  table_end();
+
+  printf("\n#endif\n");
+  return 0;
+}
@@ -23,9 +23,12 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "ymf262.h"
+#include "ymf262simd.h"
+#include "ymf262tab.h"
 
 /***** Defines *****/
 
@@ -33,7 +36,7 @@
  * inline definitions for certain systems. Supported systems at this time
  * are: gcc, MSVC
  */
-#ifdef __GCC__
+#ifdef __GNUC__
 #	define INLINE	inline
 #elif defined(_MSC_VER)
 #	define INLINE	__inline
@@ -41,141 +44,1079 @@
 #	define INLINE
 #endif
 
+/* restrict qualifier for pointers to operator state arrays */
+#if defined(__GNUC__) || defined(_MSC_VER)
+#	define RESTRICT	__restrict
+#else
+#	define RESTRICT
+#endif
+
+/* Ordered access to the indices of the ymf262_post() ring */
+#ifdef __GNUC__
+#	define LOAD_ACQUIRE(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#	define STORE_RELEASE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else	/* volatile accesses are acquire and release on MSVC */
+#	define LOAD_ACQUIRE(p)		(*(volatile uint32 *)(p))
+#	define STORE_RELEASE(p, v)	(*(volatile uint32 *)(p) = (v))
+#endif
+
+/* Render statistics, or nothing at all */
+#ifdef YMF262_PROFILE
+#	define STATS_BEGIN(opl)		((opl)->stats_mark = stats_cycles())
+#	define STATS_END(opl, stage, count)				\
+	((opl)->stats.cycles[stage] += stats_cycles() - (opl)->stats_mark,	\
+	 (opl)->stats.items[stage] += (count))
+#	define STATS_ADD(opl, field, count)	((opl)->stats.field += (count))
+#else
+#	define STATS_BEGIN(opl)
+#	define STATS_END(opl, stage, count)
+#	define STATS_ADD(opl, field, count)
+#endif
+
+#if defined(YMF262_PROFILE) && defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+/* Sampling rate of the real chip (14.318 MHz / 288) */
+#define OPL_RATE	49716
+
 /* pi */
-#define PI	3.141592653
+#define PI	3.14159265358979
 
 /* Boolean values */
 #define TRUE	1
 #define FALSE	0
 
+/* Number of samples rendered at a time by ymf262_batch_render() */
+#define BATCH_BLOCK	64
+
+/***** Types *****/
+
+struct YMF262_BATCH {
+  uint32	lanes;
+  YMF262	**chip;		/* registers and write queue of every lane */
+  uint8		*loaded;	/* TRUE if the lane's operators are in 'bank' */
+  void		*mem;		/* holds all of the following */
+
+  YMF262_BANK	bank;		/* slot 'op * lanes + lane' */
+  uint32	*phase, *env;	/* block buffers, BATCH_BLOCK rows */
+  int32		*mix;		/* 4 outputs of BATCH_BLOCK rows of lanes */
+  uint32	*car, *am, *fm;	/* masks, 4 outputs of car and am */
+  uint32	*att;		/* tremolo attenuation of every slot */
+  uint32	*op1, *op2, *heard, *amch;	/* channel masks of every lane */
+  uint32	*groups;
+};
+
 /***** Global variables *****/
 
-/* table of the first quarter of a sine wave */
-static int16 sine[512];
+/* 4 bit register MULT -> frequency multiplier times 2 */
+static const uint8 mult_x2[16] = {
+  1, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 20, 24, 24, 30, 30
+};
 
 /***** Implementation *****/
 
-static INLINE int16 get_sine(int32 phi)
-/* Sine readout function. Virtually extends the sine table to 2048 entries. */
+#ifdef YMF262_PROFILE
+static INLINE unsigned long long stats_cycles(void)
+/* Read the time stamp counter of the CPU, where there is one. */
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+  return __builtin_ia32_rdtsc();
+#elif defined(_MSC_VER)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static uint32 stats_groups(const uint32 *groups)
+/* Returns the number of groups of 8 slots selected in 'groups'. */
 {
-  if(phi & 0x40000000) 
-    phi ^= 0x3FFFFFFF;				// symmetry to 90 and 270 dgs
+  uint32	g, count = 0;
 
-  return sine[(phi >> 21) & 511];		// map to 512 entries
+  for(g = 0; g < YMF262_OPSLOTS / 8; g++)
+    if(YMF262_GROUP(groups, g)) count++;
+
+  return count;
 }
 
-static INLINE int32 phasor_get(YMF262 *opl)
-/* Phase accumulating saw wave generator. */
+static uint32 stats_bits(uint32 x)
+/* Returns the number of bits set in 'x'. */
 {
-  return opl->phasor_phi += opl->phasor_omega;
+  uint32	count = 0;
+
+  for(; x; x &= x - 1) count++;
+  return count;
 }
+#endif
 
-static INLINE int16 waveform_get(YMF262 *opl, uint8 op, int32 phi)
+static void phasor_block(const YMF262_BANK *bank, uint32 *phase, uint32 n,
+			 const uint32 *groups)
 /*
- * OPL2 waveform generator. Four waveforms are selectable:
- *     __        __        __  __    _   _
- *    /  \      /  \___   /  \/  \  / |_/ |_
- *        \__/      
- *
- *     0:sine   1:sine>0  2:|sine|  3:chopped
+ * Phase accumulating saw wave generators. Fills the next 'n' phases of
+ * all slots in 'groups' into 'phase', the others just move on. The
+ * phases of a group are kept in a local array meanwhile, so that they
+ * stay in registers from row to row.
  */
 {
-  int16	y = get_sine(phi);
+  uint32 * RESTRICT	out = phase;
+  uint32		phi[8], omega[8], i, g, k, row;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    for(k = 0; k < 8; k++) {
+      phi[k] = bank->phase[g * 8 + k];
+      omega[k] = bank->omega[g * 8 + k];
+    }
+
+    if(YMF262_GROUP(groups, g))
+      for(i = 0, row = g * 8; i < n; i++, row += bank->slots)
+	for(k = 0; k < 8; k++)
+	  out[row + k] = phi[k] += omega[k];
+    else
+      for(k = 0; k < 8; k++)
+	phi[k] += omega[k] * n;
 
-  // use upper two bits to mangle waveform
-  if(opl->op[op].waveform == 3 && phi & 0x40000000) y = 0;
-  return (phi & 0x80000000) ? ((opl->op[op].waveform & 1) ? 0 :
-			       ((opl->op[op].waveform & 2) ? y : -y)) : y;
+    for(k = 0; k < 8; k++) bank->phase[g * 8 + k] = phi[k];
+  }
 }
 
-static INLINE uint32 env_get(YMF262 *opl, uint8 op)
+static void slot_groups(uint32 *groups, const uint32 *op1, const uint32 *op2,
+			uint32 lanes)
 /*
- * Returns current ADSR envelope level for operator 'op' and calculates
- * the next one.
+ * Set 'groups' to the groups of slots holding any operator in the masks
+ * 'op1' (operator 1) and 'op2' (operator 2) of each of 'lanes' chips.
+ * Either may be NULL for none.
  */
 {
-  uint32	out = opl->op[op].env_level;
+  uint32	lane, ch, g;
 
-  /* env_level *= 1 - 1/(2^shift) */
-  opl->op[op].env_level -= (opl->op[op].env_level >> opl->op[op].env_shift);
+  memset(groups, 0, (YMF262_OPSLOTS * lanes / 8 + 31) / 32 * sizeof(uint32));
 
-  return out;
+  for(lane = 0; lane < lanes; lane++)
+    for(ch = 0; ch < 18; ch++) {
+      if(op1 && (op1[lane] >> ch & 1)) {
+	g = (ch * lanes + lane) / 8;
+	groups[g >> 5] |= 1U << (g & 31);
+      }
+      if(op2 && (op2[lane] >> ch & 1)) {
+	g = ((YMF262_OP2 + ch) * lanes + lane) / 8;
+	groups[g >> 5] |= 1U << (g & 31);
+      }
+    }
 }
 
-static INLINE uint8 env_finished(YMF262 *opl, uint8 op)
-/* Returns whether the current ADSR run for operator 'op' has finished. */
+static void active_update(YMF262 *opl, const YMF262_BANK *bank, uint32 lanes,
+			  uint32 lane)
+/*
+ * Drop operators whose envelope has run out from the active masks of
+ * 'opl', whose operators are in 'lane' of 'bank'.
+ */
 {
-  /* OPL has only 24(?) bits so "quite zero" is OK. */
-  return !(opl->op[op].env_level >> 8);
+  uint32	bit, op;
+  uint8		half, ch;
+
+  for(half = 0; half < 2; half++)
+    for(ch = 0; ch < 18; ch++) {
+      bit = 1 << ch; op = (half * YMF262_OP2 + ch) * lanes + lane;
+
+      if((opl->active[half] & bit) &&
+	 bank->env_state[op] != YMF262_EG_ATTACK &&
+	 bank->env_att[op] >= YMF262_EG_MAX)
+	opl->active[half] &= ~bit;
+    }
 }
 
 static void keyon(YMF262 *opl, uint8 op)
 /* Set ADSR key on for operator 'op'. */
 {
-  if(opl->op[op].attack) return;	/* am already in attack */
-  opl->op[op].attack = TRUE;
+  opl->op.key[op] = TRUE;
+  opl->active[op / YMF262_OP2] |= 1 << (op % YMF262_OP2);
 
-  /* take over at current level */
-  opl->op[op].env_level = ~(opl->op[op].env_level + opl->op[op].bias);
-  opl->op[op].env_shift = opl->op[op].arate;	/* use attack rate */
+  /* the attack takes over at the current attenuation */
+  opl->op.env_state[op] = YMF262_EG_ATTACK;
 }
 
 static void keyoff(YMF262 *opl, uint8 op)
 /* Set ADSR key off for operator 'op'. */
 {
-  if(opl->op[op].attack) {
-    opl->op[op].env_level = ~opl->op[op].env_level;	/* cancel inversion */
-    opl->op[op].attack = FALSE;
-  } else {
-    opl->op[op].env_level += opl->op[op].bias;	/* take over at actual level */
-    opl->op[op].bias = 0;			/* and let go to zero */
+  if(!opl->op.key[op]) return;		/* not keyed on */
+  opl->op.key[op] = FALSE;
+
+  /* from any state, at the current attenuation */
+  opl->op.env_state[op] = YMF262_EG_RELEASE;
+}
+
+static void chip_bank(YMF262 *opl, YMF262_BANK *bank)
+/* Describe the operator slots of 'opl' as a bank. */
+{
+  bank->slots = YMF262_OPSLOTS;
+  bank->phase = opl->op.phase; bank->omega = opl->op.omega;
+  bank->env_att = opl->op.env_att; bank->env_state = opl->op.env_state;
+  bank->arate = opl->op.arate; bank->drate = opl->op.drate;
+  bank->srate = opl->op.srate; bank->rrate = opl->op.rrate;
+  bank->suslevel = opl->op.suslevel;
+  bank->wave_neg = opl->op.wave_neg; bank->wave_half = opl->op.wave_half;
+  bank->wave_quarter = opl->op.wave_quarter;
+}
+
+static uint32 channel_am(const YMF262 *opl)
+/* Returns the mask of channels in AM (additive) mode. */
+{
+  uint32	amch = 0;
+  uint8		ch;
+
+  for(ch = 0; ch < 18; ch++)
+    amch |= (uint32)opl->channel[ch].connection << ch;
+
+  return amch;
+}
+
+static void channel_outputs(const YMF262 *opl, uint32 *outs)
+/*
+ * Set outs[k] to the mask of channels heard on output channel k of the
+ * configured format. Mono is the mix of outputs A and B.
+ */
+{
+  uint32	o;
+  uint8		ch, k;
+
+  for(k = 0; k < 4; k++) outs[k] = 0;
+
+  for(ch = 0; ch < 18; ch++) {
+    o = opl->opl3 ? opl->channel[ch].output : 3;
+    for(k = 0; k < 4; k++)
+      outs[k] |= ((o >> k) & 1) << ch;
+  }
+
+  if(opl->cfg_channels == 1) outs[0] |= outs[1];
+}
+
+static void channel_update(YMF262 *opl, uint8 ch)
+/*
+ * Recalculate the phasor speeds and envelope rates of both operators of
+ * channel 'ch' from its registers. The phase has 32 bits instead of the
+ * 20 of the real chip. Envelope rates are 4 times the register rate plus
+ * the key scale offset (block and F-number bit 9) in KSR mode, plus a
+ * quarter of it otherwise, up to 63.
+ * Vibrato moves the F-number by up to 7 (14 cent) for the current LFO
+ * step, half of that unless deep vibrato is on (register 0xbd).
+ */
+{
+  uint32	fnum = opl->channel[ch].fnum, f;
+  uint8		offset = opl->channel[ch].block * 2 + (fnum >> 9), op, ks;
+  int8		vib = opl_vibrato[opl->vib_step * 8 + (fnum >> 7)];
+
+  if(!(opl->regs[0][0xbd] & 0x40)) vib /= 2;
+
+  for(op = ch; op < YMF262_OPSLOTS; op += YMF262_OP2) {
+    f = opl->vibrato[op / YMF262_OP2] >> ch & 1 ? fnum + vib : fnum;
+    opl->op.omega[op] = (f << (opl->channel[ch].block + 11)) *
+      mult_x2[opl->op.mult[op]];
+
+    ks = opl->op.ksr[op] ? offset : offset / 4;
+#define RATE(r)	((r) ? ((r) * 4 + ks < 63 ? (r) * 4 + ks : 63) : 0)
+    opl->op.arate[op] = RATE(opl->op.ar[op]);
+    opl->op.drate[op] = RATE(opl->op.dr[op]);
+    opl->op.rrate[op] = RATE(opl->op.rr[op]);
+#undef RATE
+
+    /* a percussive sound (EGT off) goes on to release from sustain */
+    opl->op.srate[op] = opl->op.egt[op] ? 0 : opl->op.rrate[op];
+  }
+
+  opl->dirty &= ~(1 << ch);
+}
+
+static void chip_update(YMF262 *opl)
+/* Bring all channels with register writes up to date. */
+{
+  uint8	ch;
+
+  for(ch = 0; opl->dirty; ch++)
+    if(opl->dirty & 1 << ch) channel_update(opl, ch);
+}
+
+static uint32 tremolo_att(const YMF262 *opl)
+/*
+ * Tremolo attenuation at the current LFO step, in envelope units of
+ * 0.1875 dB: up to 4.8 dB with deep tremolo (register 0xbd), up to 1 dB
+ * without.
+ */
+{
+  uint8	a = opl_tremolo[(opl->clock >> 6) % 210];
+
+  return opl->regs[0][0xbd] & 0x80 ? a : a >> 2;
+}
+
+static void operator_wave(const YMF262 *opl, const YMF262_BANK *bank,
+			  const uint32 *phase, const uint32 *env, int32 *out,
+			  uint32 n, const uint32 *groups)
+/* Operator outputs of the slots in 'groups', in the pipeline of 'opl'. */
+{
+  if(opl->pipeline == YMF262_PIPELINE_LOG)
+    opl->simd->wave_log(bank, opl_logsin, opl_exp, phase, env, out, n,
+			groups);
+  else
+    opl->simd->wave(bank, opl_sine, phase, env, out, n, groups);
+}
+
+static void render_block(YMF262 *opl, int32 *mix, uint32 n)
+/*
+ * Render 'n' samples of all 18 channels into 'mix', which holds one row
+ * of YMF262_BLOCK samples per output channel. Each stage runs over the
+ * whole block and all operators before the next one is started. Silent
+ * operators and channels are skipped in groups of 8 slots.
+ */
+{
+  uint32	phase[YMF262_BLOCK][YMF262_OPSLOTS] YMF262_ALIGN;
+  uint32	env[YMF262_BLOCK][YMF262_OPSLOTS] YMF262_ALIGN;
+  int32		(*out)[YMF262_OPSLOTS] = (int32 (*)[YMF262_OPSLOTS])env;
+  uint32	car[YMF262_OP2] YMF262_ALIGN, am[YMF262_OP2] YMF262_ALIGN;
+  uint32	fm[YMF262_OP2], outs[4], amch, heard, groups[1], i;
+  uint32	att[YMF262_OPSLOTS], *trem = 0, a;
+  YMF262_BANK	bank;
+  uint8		ch, k;
+
+  chip_update(opl);
+  chip_bank(opl, &bank);
+  STATS_ADD(opl, blocks, 1);
+  STATS_ADD(opl, active_ops,
+	    stats_bits(opl->active[0]) + stats_bits(opl->active[1]));
+
+  /* whole chip silent: the phases move on, nothing else does */
+  if(!(opl->active[0] | opl->active[1])) {
+    STATS_ADD(opl, idle_blocks, 1);
+    STATS_BEGIN(opl);
+    groups[0] = 0;
+    phasor_block(&bank, phase[0], n, groups);
+    STATS_END(opl, YMF262_STAGE_PHASOR, 0);
+    for(k = 0; k < opl->cfg_channels; k++)
+      memset(mix + k * YMF262_BLOCK, 0, n * sizeof(int32));
+    return;
+  }
+
+  /* operator 1 is heard through an active operator 2 (FM) or directly (AM) */
+  amch = channel_am(opl);
+  heard = opl->active[0] & (opl->active[1] | amch);
+
+  STATS_BEGIN(opl);
+  slot_groups(groups, &heard, &opl->active[1], 1);
+  phasor_block(&bank, phase[0], n, groups);
+  STATS_END(opl, YMF262_STAGE_PHASOR, stats_groups(groups) * 8 * n);
+  STATS_ADD(opl, skipped_groups, YMF262_OPSLOTS / 8 - stats_groups(groups));
+
+  STATS_BEGIN(opl);
+  slot_groups(groups, &opl->active[0], &opl->active[1], 1);
+
+  /* one tremolo step per block (see lfo_run()) */
+  if((opl->tremolo[0] & opl->active[0]) | (opl->tremolo[1] & opl->active[1])) {
+    a = tremolo_att(opl);
+    for(i = 0; i < YMF262_OPSLOTS; i++)
+      att[i] = opl->tremolo[i / YMF262_OP2] >> (i % YMF262_OP2) & 1 ? a : 0;
+    trem = att;
+  }
+  opl->simd->adsr(&bank, env[0], trem, opl->pipeline == YMF262_PIPELINE_LOG,
+		  opl->clock, n, groups);
+  STATS_END(opl, YMF262_STAGE_ENVELOPE, stats_groups(groups) * 8 * n);
+  STATS_ADD(opl, skipped_groups, YMF262_OPSLOTS / 8 - stats_groups(groups));
+
+  /* phase modulation (FM) masks */
+  for(ch = 0; ch < YMF262_OP2; ch++)
+    fm[ch] = 0 - ((heard & ~amch) >> ch & 1);
+
+  /* operator 1, then operator 2 phase modulated by it in FM mode */
+  STATS_BEGIN(opl);
+  slot_groups(groups, &heard, 0, 1);
+  operator_wave(opl, &bank, phase[0], env[0], out[0], n, groups);
+  STATS_ADD(opl, items[YMF262_STAGE_WAVEFORM], stats_groups(groups) * 8 * n);
+  for(i = 0; i < n; i++)
+    for(ch = 0; ch < YMF262_OP2; ch++)
+      phase[i][YMF262_OP2 + ch] += out[i][ch] & fm[ch];
+  slot_groups(groups, 0, &opl->active[1], 1);
+  operator_wave(opl, &bank, phase[0], env[0], out[0], n, groups);
+  STATS_END(opl, YMF262_STAGE_WAVEFORM, stats_groups(groups) * 8 * n);
+
+  /* carrier and additive (AM) output masks of every output channel */
+  STATS_BEGIN(opl);
+  channel_outputs(opl, outs);
+  for(k = 0; k < opl->cfg_channels; k++) {
+    for(ch = 0; ch < YMF262_OP2; ch++) {
+      car[ch] = 0 - ((opl->active[1] & outs[k]) >> ch & 1);
+      am[ch] = 0 - ((heard & amch & outs[k]) >> ch & 1);
+    }
+
+    opl->simd->mix((const int32 (*)[YMF262_OPSLOTS])out, car, am,
+		   mix + k * YMF262_BLOCK, n);
+  }
+  STATS_END(opl, YMF262_STAGE_MIX, n * opl->cfg_channels);
+
+  active_update(opl, &bank, 1, 0);
+}
+
+static void *aligned_malloc(size_t size)
+/*
+ * Allocate 'size' bytes, suitably aligned for the operator state arrays
+ * and on a cache line boundary.
+ */
+{
+#ifdef _MSC_VER
+  return _aligned_malloc(size, 64);
+#else
+  void	*p;
+
+  return posix_memalign(&p, 64, size) ? 0 : p;
+#endif
+}
+
+static void aligned_free(void *p)
+/* Free memory allocated by aligned_malloc(). */
+{
+#ifdef _MSC_VER
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+static INLINE uint8 queue_due(const YMF262 *opl)
+/* Returns TRUE if the first queued register write is due now. */
+{
+  uint32	due = opl->queue[opl->queue_head].time - opl->clock;
+
+  return opl->queue_len && !(due && due < 0x80000000);
+}
+
+static INLINE uint32 timer_period(const YMF262 *opl, uint8 k)
+/* Native samples from one overflow of timer 'k' (0 or 1) to the next. */
+{
+  return (uint32)(256 - opl->regs[0][2 + k]) << (k ? 4 : 2);
+}
+
+static INLINE uint8 timer_is_due(const YMF262 *opl)
+/* Returns TRUE if a running timer overflows now. */
+{
+  return (opl->regs[0][4] & 1 && opl->timer_due[0] == opl->clock) ||
+    (opl->regs[0][4] & 2 && opl->timer_due[1] == opl->clock);
+}
+
+static uint32 timer_run(YMF262 *opl, uint32 n)
+/*
+ * Overflow the timers that are due by now, late ones only once. Returns
+ * how many of the next 'n' samples can be rendered before the next
+ * overflow, if there is an IRQ callback to call at that sample.
+ */
+{
+  uint32	late, period;
+  uint8		k, flag;
+
+  for(k = 0; k < 2; k++) {
+    if(!(opl->regs[0][4] & (1 << k))) continue;	/* stopped */
+
+    if((late = opl->clock - opl->timer_due[k]) < 0x80000000) {
+      period = timer_period(opl, k);
+      opl->timer_due[k] += (late / period + 1) * period;
+
+      flag = 0x40 >> k;
+      if(!(opl->regs[0][4] & flag)) {	/* not masked */
+	if(opl->status & 0x80) opl->status |= flag;
+	else {
+	  opl->status |= 0x80 | flag;
+	  if(opl->irq) opl->irq(opl->irq_user, opl->status);
+	}
+      }
+    }
+
+    /* the callback may have stopped it */
+    if(opl->irq && opl->regs[0][4] & (1 << k) &&
+       opl->timer_due[k] - opl->clock < n)
+      n = opl->timer_due[k] - opl->clock;
+  }
+
+  return n;
+}
+
+static void timer_control(YMF262 *opl, uint8 data)
+/*
+ * Register 0x04: reset the timer flags, or start, stop and mask the
+ * timers. Starting a timer loads it with its register.
+ */
+{
+  uint8	start = data & ~opl->regs[0][4], k;
+
+  if(data & 0x80) {		/* IRQ reset, the other bits are ignored */
+    opl->status &= ~0xe0;
+    return;
+  }
+
+  opl->regs[0][4] = data;
+  for(k = 0; k < 2; k++)
+    if(start & (1 << k)) opl->timer_due[k] = opl->clock + timer_period(opl, k);
+}
+
+static INLINE uint8 vibrato_due(const YMF262 *opl)
+/* Returns TRUE if vibrato operators move on to the next LFO step now. */
+{
+  return (opl->vibrato[0] | opl->vibrato[1]) &&
+    ((opl->clock >> 10) & 7) != opl->vib_step;
+}
+
+static uint32 lfo_run(YMF262 *opl, uint32 n)
+/*
+ * Move vibrato on to the current LFO step, which the LFO takes every 1024
+ * samples, tremolo every 64. Returns how many of the next 'n' samples
+ * can be rendered before the next step of either one in use.
+ */
+{
+  uint32	left;
+
+  if(((opl->clock >> 10) & 7) != opl->vib_step) {
+    opl->vib_step = (opl->clock >> 10) & 7;
+    opl->dirty |= opl->vibrato[0] | opl->vibrato[1];
+  }
+
+  if(opl->tremolo[0] | opl->tremolo[1])
+    left = 64 - (opl->clock & 63);
+  else if(opl->vibrato[0] | opl->vibrato[1])
+    left = 1024 - (opl->clock & 1023);
+  else
+    return n;
+
+  return left < n ? left : n;
+}
+
+static uint32 queue_run(YMF262 *opl, uint32 n)
+/*
+ * Apply all queued register writes that are due now, then overflow the
+ * timers that are and take the LFO step. Returns how many of the next 'n'
+ * samples can be rendered before the next write, timer overflow or LFO
+ * step is due.
+ */
+{
+  uint32	due;
+
+  STATS_BEGIN(opl);
+  while(queue_due(opl)) {
+    ymf262_write(opl, opl->queue[opl->queue_head].set,
+		 opl->queue[opl->queue_head].index,
+		 opl->queue[opl->queue_head].data);
+    opl->queue_head = (opl->queue_head + 1) & (YMF262_QUEUE - 1);
+    opl->queue_len--;
+    STATS_ADD(opl, items[YMF262_STAGE_QUEUE], 1);
+  }
+
+  if(opl->queue_len) {		/* still in the future */
+    due = opl->queue[opl->queue_head].time - opl->clock;
+    if(due < n) n = due;
   }
 
-  opl->op[op].env_shift = opl->op[op].rrate;	/* use release rate */
+  n = lfo_run(opl, timer_run(opl, n));
+  STATS_END(opl, YMF262_STAGE_QUEUE, 0);
+  return n;
 }
 
-static int32 adsr_get(YMF262 *opl, uint8 op)
-/* Get current ADSR level for operator 'op'. */
+static void inbox_drain(YMF262 *opl)
+/*
+ * Move the writes posted by ymf262_post() into the write queue, as far as
+ * it has room for them.
+ */
 {
-  uint32	level = env_get(opl, op);	/* get new level */
+  uint32	head = opl->inbox_head, tail = LOAD_ACQUIRE(&opl->inbox_tail);
+  uint32	due;
+
+  for(; head != tail && opl->queue_len < YMF262_QUEUE; head++) {
+    due = opl->inbox[head & (YMF262_INBOX - 1)].time - opl->frames;
+    ymf262_write_at(opl, due < 0x80000000 ? due : 0,
+		    opl->inbox[head & (YMF262_INBOX - 1)].set,
+		    opl->inbox[head & (YMF262_INBOX - 1)].index,
+		    opl->inbox[head & (YMF262_INBOX - 1)].data);
+  }
 
-  if(opl->op[op].attack) {
-    if(env_finished(opl, op)) {		/* time to go from attack to decay */
-      opl->op[op].attack = FALSE;
-      opl->op[op].bias = opl->op[op].suslevel;	/* bias is now sustain level */
-      /* leave room for the bias */
-      opl->op[op].env_level = ~opl->op[op].suslevel;
-      opl->op[op].env_shift = opl->op[op].drate;	/* use decay rate */
+  STORE_RELEASE(&opl->inbox_head, head);
+}
+
+static void pull_run(YMF262 *opl, uint32 n)
+/*
+ * Queue the writes from the pull callback that take effect within the
+ * next 'n' output samples, as far as the write queue has room for them.
+ */
+{
+  YMF262_EVENT	ev;
+  uint32	due;
+
+  if(!opl->pull) return;
+
+  while(opl->queue_len < YMF262_QUEUE &&
+	opl->pull(opl->pull_user, opl->frames + n, &ev)) {
+    due = ev.time - opl->frames;
+    ymf262_write_at(opl, due < 0x80000000 ? due : 0, ev.set, ev.index,
+		    ev.data);
+  }
+}
+
+static void chip_skip(YMF262 *opl, uint32 n)
+/*
+ * Move the chip on by 'n' native samples without rendering them: the
+ * phases and envelopes end up where render_block() would leave them, and
+ * queued register writes are applied at their time.
+ */
+{
+  YMF262_BANK	bank;
+  uint32	groups[1], m, op;
+
+  chip_bank(opl, &bank);
+
+  for(; n; n -= m) {
+    m = queue_run(opl, n);
+    chip_update(opl);
+
+    for(op = 0; op < YMF262_OPSLOTS; op++)
+      opl->op.phase[op] += opl->op.omega[op] * m;
+
+    /* envelopes only do work where they move, skipping costs no more */
+    slot_groups(groups, &opl->active[0], &opl->active[1], 1);
+    opl->simd->adsr(&bank, 0, 0, FALSE, opl->clock, m, groups);
+
+    active_update(opl, &bank, 1, 0);
+    opl->clock += m;
+  }
+}
+
+static void output(YMF262 *opl, const int32 *mix, void *buffer, uint32 n)
+/*
+ * Store 'n' samples of the YMF262_BLOCK sample rows of 'mix' in 'buffer',
+ * channels interleaved, in the configured format.
+ */
+{
+  int32		frames[YMF262_BLOCK * 4];
+  uint32	i;
+  uint8		k;
+
+  STATS_BEGIN(opl);
+  if(opl->cfg_channels == 1)
+    opl->simd->convert(mix, buffer, n, opl->cfg_bits);
+  else {
+    for(k = 0; k < opl->cfg_channels; k++)
+      for(i = 0; i < n; i++)
+	frames[i * opl->cfg_channels + k] = mix[k * YMF262_BLOCK + i];
+
+    opl->simd->convert(frames, buffer, n * opl->cfg_channels, opl->cfg_bits);
+  }
+  STATS_END(opl, YMF262_STAGE_OUTPUT, n * opl->cfg_channels);
+}
+
+/***** Resampling *****/
+
+static uint8 resample_init(YMF262 *opl, uint8 quality)
+/*
+ * Set up the resampler for 'quality': a Blackman windowed sinc filter,
+ * cutting off a little below half of the lower one of the two rates.
+ */
+{
+  static const uint8	taps[3] = { 8, 16, 32 };
+  static const double	passband[3] = { 0.80, 0.90, 0.95 };
+  double		fc, d, h[YMF262_TAPS], sum;
+  float			*coef = opl->rs.coef;	/* room for the most taps */
+  uint32		t, p, len;
+
+  if(quality > YMF262_QUALITY_HIGH) return FALSE;
+  if(opl->cfg_rate == OPL_RATE) return TRUE;	/* nothing to resample */
+
+  len = taps[quality];
+
+  /* cutoff in cycles per native sample */
+  fc = 0.5 * passband[quality] *
+    (opl->cfg_rate < OPL_RATE ? (double)opl->cfg_rate / OPL_RATE : 1.0);
+
+  for(p = 0; p < YMF262_PHASES; p++) {
+    for(sum = 0, t = 0; t < len; t++) {
+      d = (double)p / YMF262_PHASES + len / 2 - 1 - t;	/* tap distance */
+      h[t] = (d ? sin(2 * PI * fc * d) / (PI * d) : 2 * fc) *
+	(0.42 + 0.5 * cos(2 * PI * d / len) + 0.08 * cos(4 * PI * d / len));
+      sum += h[t];
     }
 
-    return ~level;		/* if attack: level goes up */
+    for(t = 0; t < len; t++)	/* unity gain at DC in every phase */
+      coef[p * len + t] = (float)(h[t] / sum);
   }
 
-  return level + opl->op[op].bias;	/* no attack: level goes down */
+  opl->rs.taps = len;
+  opl->rs.step = ((unsigned long long)OPL_RATE << 32) / opl->cfg_rate;
+
+  /* start on silence, with the first output sample on the first input */
+  memset(opl->rs.in, 0, sizeof(opl->rs.in));
+  opl->rs.fill = len - 1;
+  opl->rs.pos = (unsigned long long)(len / 2 - 1) << 32;
+  return TRUE;
 }
 
-static void one_time_init(void)
-/* One-time global variable initialization procedure. */
+static INLINE uint8 resample_ready(const YMF262 *opl)
+/* Returns TRUE if the next output sample can be resampled. */
+{
+  return (opl->rs.pos >> 32) + opl->rs.taps / 2 < opl->rs.fill;
+}
+
+static uint32 resample_need(YMF262 *opl, uint32 n)
+/*
+ * Drop the buffered native samples that no output sample needs any more.
+ * Returns how many native samples to render for the next 'n' output
+ * samples, as many as fit into the buffer.
+ */
+{
+  uint32	drop = (uint32)(opl->rs.pos >> 32) + 1 - opl->rs.taps / 2;
+  uint32	need, room;
+  uint8		k;
+
+  if(drop > opl->rs.fill) drop = opl->rs.fill;
+  if(drop) {
+    for(k = 0; k < opl->cfg_channels; k++)
+      memmove(opl->rs.in[k], opl->rs.in[k] + drop,
+	      (opl->rs.fill - drop) * sizeof(float));
+    opl->rs.fill -= drop;
+    opl->rs.pos -= (unsigned long long)drop << 32;
+  }
+
+  need = (uint32)((opl->rs.pos + (unsigned long long)(n - 1) * opl->rs.step)
+		  >> 32) + opl->rs.taps / 2 + 1 - opl->rs.fill;
+  room = YMF262_TAPS + YMF262_BLOCK - opl->rs.fill;
+  if(room > YMF262_BLOCK) room = YMF262_BLOCK;
+
+  return need < room ? need : room;
+}
+
+static void resample_in(YMF262 *opl, const int32 *mix, uint32 n)
+/* Append 'n' native samples of the rows of 'mix' to the resampler input. */
 {
-  static uint8	one_time = FALSE;	/* one-time init flag */
   uint32	i;
+  uint8		k;
+
+  for(k = 0; k < opl->cfg_channels; k++)
+    for(i = 0; i < n; i++)
+      opl->rs.in[k][opl->rs.fill + i] = (float)mix[k * YMF262_BLOCK + i];
+
+  opl->rs.fill += n;
+}
+
+static uint32 resample_out(YMF262 *opl, int32 *mix, uint32 n)
+/*
+ * Resample up to 'n' samples of every output channel into the rows of
+ * 'mix'. Returns how many the buffered native samples were enough for.
+ */
+{
+  unsigned long long	pos = opl->rs.pos;
+  uint32		done = 0;
+  uint8			k;
 
-  if(one_time) return;	/* Return immediately, if already initialized */
-  one_time = TRUE;
+  STATS_BEGIN(opl);
+  for(k = 0; k < opl->cfg_channels; k++) {
+    pos = opl->rs.pos;
+    done = opl->simd->resample(opl->rs.in[k], opl->rs.fill, opl->rs.coef,
+			       opl->rs.taps, &pos, opl->rs.step,
+			       mix + k * YMF262_BLOCK, n);
+  }
+  STATS_END(opl, YMF262_STAGE_RESAMPLE, done * opl->cfg_channels);
+
+  opl->rs.pos = pos;
+  return done;
+}
+
+static uint32 render_out(YMF262 *opl, int32 *mix, uint32 n)
+/*
+ * Render up to 'n' samples at the output rate into the rows of 'mix'.
+ * Returns how many were rendered.
+ */
+{
+  int32		native[4 * YMF262_BLOCK];
+  uint32	m;
+
+  inbox_drain(opl);
+  pull_run(opl, n);
+
+  if(!opl->rs.taps) {		/* running at the native rate */
+    n = queue_run(opl, n);
+    render_block(opl, mix, n);
+    opl->clock += n;
+    opl->frames += n;
+    return n;
+  }
+
+  while(!resample_ready(opl)) {
+    m = queue_run(opl, resample_need(opl, n));
+    render_block(opl, native, m);
+    opl->clock += m;
+    resample_in(opl, native, m);
+  }
+
+  n = resample_out(opl, mix, n);
+  opl->frames += n;
+  return n;
+}
+
+/***** Batch rendering *****/
+
+static void lane_load(YMF262_BATCH *batch, uint32 lane)
+/* Copy the operator state of the chip of 'lane' into the bank. */
+{
+  YMF262	*opl = batch->chip[lane];
+  YMF262_BANK	*bank = &batch->bank;
+  uint32	op, s;
+
+  for(op = 0; op < YMF262_OPSLOTS; op++) {
+    s = op * batch->lanes + lane;
+    bank->phase[s] = opl->op.phase[op];
+    bank->omega[s] = opl->op.omega[op];
+    bank->env_att[s] = opl->op.env_att[op];
+    bank->env_state[s] = opl->op.env_state[op];
+    bank->arate[s] = opl->op.arate[op];
+    bank->drate[s] = opl->op.drate[op];
+    bank->srate[s] = opl->op.srate[op];
+    bank->rrate[s] = opl->op.rrate[op];
+    bank->suslevel[s] = opl->op.suslevel[op];
+    bank->wave_neg[s] = opl->op.wave_neg[op];
+    bank->wave_half[s] = opl->op.wave_half[op];
+    bank->wave_quarter[s] = opl->op.wave_quarter[op];
+  }
+
+  batch->loaded[lane] = TRUE;
+}
+
+static void lane_store(YMF262_BATCH *batch, uint32 lane)
+/* Copy the operator state rendering changes back to the chip of 'lane'. */
+{
+  YMF262	*opl = batch->chip[lane];
+  YMF262_BANK	*bank = &batch->bank;
+  uint32	op, s;
+
+  for(op = 0; op < YMF262_OPSLOTS; op++) {
+    s = op * batch->lanes + lane;
+    opl->op.phase[op] = bank->phase[s];
+    opl->op.env_att[op] = bank->env_att[s];
+    opl->op.env_state[op] = bank->env_state[s];
+  }
+
+  batch->loaded[lane] = FALSE;
+}
+
+static void fm_add(uint32 * RESTRICT phase, const int32 * RESTRICT out,
+		   const uint32 * RESTRICT fm, uint32 n)
+/* Phase modulate 'n' slots of a row of 'phase' by 'out', masked by 'fm'. */
+{
+  uint32	s;
+
+  for(s = 0; s < n; s++)
+    phase[s] += out[s] & fm[s];
+}
+
+static void mix_lanes(int32 * RESTRICT mix, const int32 * RESTRICT out,
+		      const uint32 * RESTRICT car, const uint32 * RESTRICT am,
+		      uint32 lanes, uint32 channels)
+/*
+ * Mix 'channels' channels of every lane, one row of slots from 'out' on,
+ * into the row of 'lanes' samples in 'mix': operator 2 where 'car' is set,
+ * operator 1 where 'am' is set. Lanes are summed 4 at a time in a local
+ * array, which the compiler keeps in a vector register.
+ */
+{
+  uint32	ch, lane, s, j, half = YMF262_OP2 * lanes;
+  int32		sum[4];
 
-  /* Initialize the global sine array */
-  for(i = 0; i < 512; i++)
-    sine[i] = (int16)(32767.0 * sin(i / 1024.0 * PI));
+  for(lane = 0; lane < lanes; lane += 4) {
+    for(j = 0; j < 4; j++) sum[j] = 0;
+
+    if(lane + 4 <= lanes)
+      for(ch = 0, s = lane; ch < channels; ch++, s += lanes)
+	for(j = 0; j < 4; j++)
+	  sum[j] += ((out[half + s + j] >> 16) & car[s + j]) +
+	    ((out[s + j] >> 16) & am[s + j]);
+    else
+      for(ch = 0, s = lane; ch < channels; ch++, s += lanes)
+	for(j = 0; j < lanes - lane; j++)
+	  sum[j] += ((out[half + s + j] >> 16) & car[s + j]) +
+	    ((out[s + j] >> 16) & am[s + j]);
+
+    for(j = 0; j < 4 && lane + j < lanes; j++) mix[lane + j] = sum[j];
+  }
+}
+
+static void batch_block(YMF262_BATCH *batch, uint32 n)
+/*
+ * Render 'n' samples of every lane into batch->mix, the way render_block()
+ * does for a single chip. Slot 'op * lanes + lane' of the bank holds
+ * operator slot 'op' of the chip of 'lane'.
+ */
+{
+  const struct YMF262_SIMD *simd = batch->chip[0]->simd;
+  YMF262_BANK		*bank = &batch->bank;
+  YMF262		*opl;
+  uint32		lanes = batch->lanes, half = YMF262_OP2 * lanes;
+  uint32 * RESTRICT	car = batch->car;
+  uint32 * RESTRICT	am = batch->am;
+  uint32 * RESTRICT	fm = batch->fm;
+  int32			*out = (int32 *)batch->env;
+  uint32		outs[4], chans[4], any = 0, fmch = 0, trem = 0;
+  uint32		lane, i, s, ch, lo, hi, a;
+  uint8			k, outputs = batch->chip[0]->cfg_channels;
+
+  /* active masks of every lane, as in render_block() */
+  for(lane = 0; lane < lanes; lane++) {
+    opl = batch->chip[lane];
+    batch->op1[lane] = opl->active[0];
+    batch->op2[lane] = opl->active[1];
+    batch->amch[lane] = channel_am(opl);
+    batch->heard[lane] = opl->active[0] &
+      (opl->active[1] | batch->amch[lane]);
+    any |= opl->active[0] | opl->active[1];
+    fmch |= batch->heard[lane] & ~batch->amch[lane];
+    trem |= (opl->tremolo[0] & opl->active[0]) |
+      (opl->tremolo[1] & opl->active[1]);
+  }
+
+  /* all chips silent: the phases move on, nothing else does */
+  if(!any) {
+    slot_groups(batch->groups, 0, 0, lanes);
+    phasor_block(bank, batch->phase, n, batch->groups);
+    for(k = 0; k < outputs; k++)
+      memset(batch->mix + k * BATCH_BLOCK * lanes, 0,
+	     n * lanes * sizeof(int32));
+    return;
+  }
+
+  slot_groups(batch->groups, batch->heard, batch->op2, lanes);
+  phasor_block(bank, batch->phase, n, batch->groups);
+
+  /* tremolo, as in render_block() */
+  if(trem)
+    for(lane = 0; lane < lanes; lane++) {
+      opl = batch->chip[lane];
+      a = tremolo_att(opl);
+      for(i = 0, s = lane; i < YMF262_OPSLOTS; i++, s += lanes)
+	batch->att[s] =
+	  opl->tremolo[i / YMF262_OP2] >> (i % YMF262_OP2) & 1 ? a : 0;
+    }
+
+  /* lanes are created and rendered together: one envelope counter */
+  slot_groups(batch->groups, batch->op1, batch->op2, lanes);
+  simd->adsr(bank, batch->env, trem ? batch->att : 0,
+	     batch->chip[0]->pipeline == YMF262_PIPELINE_LOG,
+	     batch->chip[0]->clock, n, batch->groups);
+
+  /* masks of every lane and output channel, as in render_block() */
+  for(k = 0; k < outputs; k++) chans[k] = 0;
+  for(lane = 0; lane < lanes; lane++) {
+    channel_outputs(batch->chip[lane], outs);
+
+    for(ch = 0; ch < YMF262_OP2; ch++) {
+      s = ch * lanes + lane;
+      fm[s] = 0 - ((batch->heard[lane] & ~batch->amch[lane]) >> ch & 1);
+
+      for(k = 0; k < outputs; k++) {
+	car[k * half + s] = 0 - ((batch->op2[lane] & outs[k]) >> ch & 1);
+	am[k * half + s] =
+	  0 - ((batch->heard[lane] & batch->amch[lane] & outs[k]) >> ch & 1);
+      }
+    }
+
+    for(k = 0; k < outputs; k++)
+      chans[k] |= (batch->op2[lane] |
+		   (batch->heard[lane] & batch->amch[lane])) & outs[k];
+  }
+
+  slot_groups(batch->groups, batch->heard, 0, lanes);
+  operator_wave(batch->chip[0], bank, batch->phase, batch->env, out, n,
+		batch->groups);
+  /* phase modulation, over the channels some lane has in FM mode */
+  if(fmch) {
+    for(lo = 0; !(fmch >> lo & 1); lo++);
+    for(hi = 17; !(fmch >> hi & 1); hi--);
+    for(i = 0; i < n; i++)
+      fm_add(batch->phase + i * bank->slots + half + lo * lanes,
+	     out + i * bank->slots + lo * lanes, fm + lo * lanes,
+	     (hi + 1 - lo) * lanes);
+  }
+  slot_groups(batch->groups, 0, batch->op2, lanes);
+  operator_wave(batch->chip[0], bank, batch->phase, batch->env, out, n,
+		batch->groups);
+
+  /* channel mix, all lanes side by side, over the channels heard */
+  for(k = 0; k < outputs; k++) {
+    if(!chans[k]) {
+      memset(batch->mix + k * BATCH_BLOCK * lanes, 0,
+	     n * lanes * sizeof(int32));
+      continue;
+    }
+
+    for(lo = 0; !(chans[k] >> lo & 1); lo++);
+    for(hi = 17; !(chans[k] >> hi & 1); hi--);
+    for(i = 0; i < n; i++)
+      mix_lanes(batch->mix + (k * BATCH_BLOCK + i) * lanes,
+		out + i * bank->slots + lo * lanes, car + k * half + lo * lanes,
+		am + k * half + lo * lanes, lanes, hi + 1 - lo);
+  }
+
+  for(lane = 0; lane < lanes; lane++)
+    active_update(batch->chip[lane], bank, lanes, lane);
+}
+
+static uint32 batch_native(YMF262_BATCH *batch, uint32 n)
+/*
+ * Render up to 'n' native samples of every lane into batch->mix. The
+ * block ends before the next queued write of any lane is due. Returns the
+ * number of samples rendered.
+ */
+{
+  uint32	lane;
+
+  for(lane = 0; lane < batch->lanes; lane++) {
+    if(batch->loaded[lane] && (queue_due(batch->chip[lane]) ||
+			       vibrato_due(batch->chip[lane]) ||
+			       (batch->chip[lane]->irq &&
+				timer_is_due(batch->chip[lane]))))
+      lane_store(batch, lane);
+    n = queue_run(batch->chip[lane], n);
+    if(!batch->loaded[lane]) {
+      chip_update(batch->chip[lane]);
+      lane_load(batch, lane);
+    }
+  }
+
+  batch_block(batch, n);
+
+  for(lane = 0; lane < batch->lanes; lane++)
+    batch->chip[lane]->clock += n;
+
+  return n;
+}
+
+static void batch_lane(YMF262_BATCH *batch, uint32 lane, int32 *mix,
+		       uint32 n)
+/* Copy 'n' samples of 'lane' from batch->mix into the rows of 'mix'. */
+{
+  uint32	i;
+  uint8		k;
+
+  for(k = 0; k < batch->chip[lane]->cfg_channels; k++)
+    for(i = 0; i < n; i++)
+      mix[k * YMF262_BLOCK + i] =
+	batch->mix[(k * BATCH_BLOCK + i) * batch->lanes + lane];
 }
 
 /***** Exported functions *****/
 
-YMF262 *ymf262_create(uint8 channels, uint8 bits, uint32 rate)
+uint32 ymf262_size(uint32 rate)
 {
-  YMF262	*opl = (YMF262 *)malloc(sizeof(YMF262));
+  /* the resampling filter follows on the next cache line */
+  return (sizeof(YMF262) + 63) / 64 * 64 + (rate == OPL_RATE ? 0 :
+    YMF262_PHASES * YMF262_TAPS * sizeof(float));
+}
 
-  /* One-time initialization procedure */
-  one_time_init();
+YMF262 *ymf262_init_in(void *mem, uint8 channels, uint8 bits, uint32 rate)
+{
+  YMF262	*opl = (YMF262 *)mem;
+  uint32	i;
+
+  if(rate < OPL_RATE / 32) return 0;	/* resampler would run dry */
+  if(channels != 1 && channels != 2 && channels != 4) return 0;
+  if(bits != 8 && bits != 16 && bits != 24 && bits != 32) return 0;
+  if((size_t)mem & 63) return 0;	/* not on a cache line boundary */
 
   /* Reset data */
   memset(opl, 0, sizeof(YMF262));
@@ -185,24 +1126,484 @@ YMF262 *ymf262_create(uint8 channels, uint8 bits, uint32 rate)
   opl->cfg_bits = bits;
   opl->cfg_rate = rate;
 
+  /* Select SIMD kernels for this CPU, all operators start with a sine */
+  opl->simd = ymf262_simd_select();
+  memset(opl->op.wave_neg, 0xff, sizeof(opl->op.wave_neg));
+  opl->dirty = (1 << 18) - 1;
+
+  /*
+   * Registers start out 0 and ymf262_write() drops writes that leave
+   * them unchanged, so all derived state has to match 0 from the start.
+   * All envelopes start out released and silent.
+   */
+  for(i = 0; i < YMF262_OPSLOTS; i++) {
+    opl->op.env_att[i] = YMF262_EG_MAX;
+    opl->op.env_state[i] = YMF262_EG_RELEASE;
+  }
+
+  if(rate != OPL_RATE)
+    opl->rs.coef = (float *)((uint8 *)mem + (sizeof(YMF262) + 63) / 64 * 64);
+  resample_init(opl, YMF262_QUALITY_MEDIUM);
+
+  return opl;
+}
+
+YMF262 *ymf262_create(uint8 channels, uint8 bits, uint32 rate)
+{
+  void		*mem;
+  YMF262	*opl;
+
+  if(!(mem = aligned_malloc(ymf262_size(rate)))) return 0;
+  if(!(opl = ymf262_init_in(mem, channels, bits, rate))) aligned_free(mem);
   return opl;
 }
 
 void ymf262_destroy(YMF262 *opl)
 {
-  /* Free YMF262 data structure itself */
-  free(opl);
+  /* Free the YMF262 data structure, resampling filter included */
+  aligned_free(opl);
+}
+
+uint8 ymf262_set_quality(YMF262 *opl, uint8 quality)
+{
+  return resample_init(opl, quality);
+}
+
+uint8 ymf262_set_pipeline(YMF262 *opl, uint8 pipeline)
+{
+  if(pipeline > YMF262_PIPELINE_LOG) return FALSE;
+  opl->pipeline = pipeline;
+  return TRUE;
 }
 
 void ymf262_render(YMF262 *opl, void *buffer, uint32 length)
 {
+  uint8		*out = (uint8 *)buffer;
+  int32		mix[4 * YMF262_BLOCK];
+  uint32	frame = opl->cfg_channels * (opl->cfg_bits / 8);
+  uint32	samples = length / frame, n;
+
+  while(samples) {
+    n = render_out(opl, mix, samples < YMF262_BLOCK ? samples : YMF262_BLOCK);
+    output(opl, mix, out, n);
+    out += n * frame; samples -= n;
+  }
+}
+
+void ymf262_render_planar(YMF262 *opl, void **buffers, uint32 length)
+{
+  int32		mix[4 * YMF262_BLOCK];
+  uint32	bytes = opl->cfg_bits / 8, samples = length / bytes, pos, n;
+  uint8		k;
+
+  for(pos = 0; pos < samples; pos += n) {
+    n = render_out(opl, mix, samples - pos < YMF262_BLOCK ?
+		   samples - pos : YMF262_BLOCK);
+
+    STATS_BEGIN(opl);
+    for(k = 0; k < opl->cfg_channels; k++)
+      opl->simd->convert(mix + k * YMF262_BLOCK,
+			 (uint8 *)buffers[k] + pos * bytes, n, opl->cfg_bits);
+    STATS_END(opl, YMF262_STAGE_OUTPUT, n * opl->cfg_channels);
+  }
+}
+
+static void skip_out(YMF262 *opl, uint32 n)
+/* Move on by 'n' output samples without rendering them. */
+{
+  unsigned long long	target;
+  uint32		first;
+
+  opl->frames += n;
+
+  if(!opl->rs.taps) {		/* running at the native rate */
+    chip_skip(opl, n);
+    return;
+  }
+
+  /*
+   * Native samples before the filter window of the first output sample
+   * after the skip are never heard, skip those. The window itself is
+   * rendered as usual by the next ymf262_render().
+   */
+  target = opl->rs.pos + (unsigned long long)n * opl->rs.step;
+  first = (uint32)(target >> 32) + 1 - opl->rs.taps / 2;
+
+  if(first > opl->rs.fill) {
+    chip_skip(opl, first - opl->rs.fill);
+    opl->rs.fill = 0;
+    target -= (unsigned long long)first << 32;
+  }
+
+  opl->rs.pos = target;
+}
+
+void ymf262_skip(YMF262 *opl, uint32 samples)
+{
+  uint32	n;
+
+  for(; samples; samples -= n) {
+    inbox_drain(opl);
+    pull_run(opl, samples);
+
+    /*
+     * A full queue may have held back writes due within the skip. Go on
+     * a block at a time then, picking them up as ymf262_render() does.
+     */
+    n = opl->queue_len == YMF262_QUEUE && samples > YMF262_BLOCK ?
+      YMF262_BLOCK : samples;
+    skip_out(opl, n);
+  }
 }
 
 void ymf262_write(YMF262 *opl, uint8 set, uint8 index, uint8 data)
 {
+  uint8	slot = index & 0x1f, ch, op, k, old = opl->regs[set][index];
+
+  if(!set && index == 0x04) {	/* timer control, acts even unchanged */
+    timer_control(opl, data);
+    return;
+  }
+
+  /* nothing changes, derived state included (see ymf262_create()) */
+  if(data == old) return;
+  opl->regs[set][index] = data;
+
+  switch(index & 0xf0) {
+  case 0xa0:	/* F-number low 8 bits */
+  case 0xb0:	/* key on, block, F-number high 2 bits */
+  case 0xc0:	/* connection */
+    if((index & 0x0f) > 8) {	/* 0xbd: LFO depths, rhythm not supported */
+      if(!set && index == 0xbd)
+	opl->dirty |= opl->vibrato[0] | opl->vibrato[1];
+      return;
+    }
+    ch = set * 9 + (index & 0x0f);
+
+    switch(index & 0xf0) {
+    case 0xa0:
+      opl->channel[ch].fnum = (opl->channel[ch].fnum & 0x300) | data;
+      opl->dirty |= 1 << ch;
+      break;
+    case 0xb0:
+      opl->channel[ch].fnum = (opl->channel[ch].fnum & 0xff) |
+	((data & 3) << 8);
+      opl->channel[ch].block = (data >> 2) & 7;
+      if((old ^ data) & 0x1f) opl->dirty |= 1 << ch;
+      if(!((old ^ data) & 0x20)) break;	/* key stays as it is */
+
+      /* key on below needs the new rates, with any F-number low written */
+      if(opl->dirty & (1 << ch)) channel_update(opl, ch);
+      if(data & 0x20) {
+	keyon(opl, ch); keyon(opl, ch + YMF262_OP2);
+      } else {
+	keyoff(opl, ch); keyoff(opl, ch + YMF262_OP2);
+      }
+      break;
+    case 0xc0:
+      opl->channel[ch].connection = data & 1;
+      opl->channel[ch].output = data >> 4;
+      break;
+    }
+    return;
+  }
+
+  if(set && index == 0x05) {	/* OPL3 mode */
+    opl->opl3 = data & 1;
+    return;
+  }
+
+  /* operator registers: 18 slots per set, 0x00 - 0x15 without holes */
+  if(slot > 0x15 || (slot & 7) > 5) return;
+  ch = set * 9 + (slot >> 3) * 3 + (slot & 7) % 3;
+  op = (slot & 7) < 3 ? ch : ch + YMF262_OP2;
+
+  switch(index & 0xe0) {
+  case 0x20:	/* AM, VIB, EGT, KSR, frequency multiplier */
+    k = op / YMF262_OP2;
+    opl->tremolo[k] = (opl->tremolo[k] & ~(1 << ch)) | (data >> 7 & 1) << ch;
+    opl->vibrato[k] = (opl->vibrato[k] & ~(1 << ch)) | (data >> 6 & 1) << ch;
+    opl->op.egt[op] = (data >> 5) & 1;
+    opl->op.ksr[op] = (data >> 4) & 1;
+    opl->op.mult[op] = data & 15;
+    opl->dirty |= 1 << ch;
+    break;
+  case 0x60:	/* attack rate, decay rate */
+    opl->op.ar[op] = data >> 4;
+    opl->op.dr[op] = data & 15;
+    opl->dirty |= 1 << ch;
+    break;
+  case 0x80:	/* sustain level, release rate */
+    opl->op.suslevel[op] = opl_sustain[data >> 4];
+    opl->op.rr[op] = data & 15;
+    opl->dirty |= 1 << ch;
+    break;
+  case 0xe0:	/* waveform select */
+    opl->op.waveform[op] = data & 3;
+    opl->op.wave_neg[op] = opl->op.waveform[op] == 0 ? ~0 : 0;
+    opl->op.wave_half[op] = opl->op.waveform[op] & 1 ? ~0 : 0;
+    opl->op.wave_quarter[op] = opl->op.waveform[op] == 3 ? ~0 : 0;
+    break;
+  }
+}
+
+uint8 ymf262_write_at(YMF262 *opl, uint32 offset, uint8 set, uint8 index,
+		      uint8 data)
+{
+  uint32	time = opl->clock + offset, i, prev;
+
+  if(opl->queue_len == YMF262_QUEUE) return FALSE;	/* queue full */
+
+  /* the native sample at the front edge of the filter for that sample */
+  if(opl->rs.taps)
+    time = opl->clock - opl->rs.fill + opl->rs.taps / 2 +
+      (uint32)((opl->rs.pos + (unsigned long long)offset * opl->rs.step) >> 32);
+
+  /* insert sorted, scanning back from the end (usually appends at once) */
+  i = (opl->queue_head + opl->queue_len) & (YMF262_QUEUE - 1);
+  while(i != opl->queue_head) {
+    prev = (i - 1) & (YMF262_QUEUE - 1);
+    if((int32)(opl->queue[prev].time - time) <= 0) break;
+    opl->queue[i] = opl->queue[prev];
+    i = prev;
+  }
+
+  opl->queue[i].time = time;
+  opl->queue[i].set = set;
+  opl->queue[i].index = index;
+  opl->queue[i].data = data;
+  opl->queue_len++;
+  return TRUE;
+}
+
+uint8 ymf262_post(YMF262 *opl, uint32 time, uint8 set, uint8 index,
+		  uint8 data)
+{
+  uint32	tail = opl->inbox_tail;
+
+  if(tail - LOAD_ACQUIRE(&opl->inbox_head) == YMF262_INBOX)
+    return FALSE;		/* inbox full */
+
+  opl->inbox[tail & (YMF262_INBOX - 1)].time = time;
+  opl->inbox[tail & (YMF262_INBOX - 1)].set = set;
+  opl->inbox[tail & (YMF262_INBOX - 1)].index = index;
+  opl->inbox[tail & (YMF262_INBOX - 1)].data = data;
+  STORE_RELEASE(&opl->inbox_tail, tail + 1);
+  return TRUE;
+}
+
+void ymf262_set_pull(YMF262 *opl, ymf262_pull_fn pull, void *user)
+{
+  opl->pull = pull;
+  opl->pull_user = user;
+}
+
+uint8 ymf262_get_stats(const YMF262 *opl, YMF262_STATS *stats)
+{
+#ifdef YMF262_PROFILE
+  *stats = opl->stats;
+  return TRUE;
+#else
+  (void)opl;
+  memset(stats, 0, sizeof(YMF262_STATS));
+  return FALSE;
+#endif
+}
+
+void ymf262_reset_stats(YMF262 *opl)
+{
+  memset(&opl->stats, 0, sizeof(YMF262_STATS));
 }
 
 uint8 ymf262_readstatus(YMF262 *opl)
 {
+  /*
+   * Without a callback, blocks run past overflows: catch up with those.
+   * With one they are split there, and what is due now overflows (and
+   * calls it) as the next sample is rendered.
+   */
+  if(!opl->irq) timer_run(opl, 0);
   return opl->status;
 }
+
+void ymf262_set_irq(YMF262 *opl, ymf262_irq_fn irq, void *user)
+{
+  opl->irq = irq;
+  opl->irq_user = user;
+}
+
+YMF262_BATCH *ymf262_batch_create(uint32 lanes, uint8 channels, uint8 bits,
+				  uint32 rate)
+{
+  YMF262_BATCH	*batch;
+  YMF262_BANK	*bank;
+  uint32	slots = YMF262_OPSLOTS * lanes, *p, lane;
+
+  if(!lanes) return 0;
+  if(!(batch = (YMF262_BATCH *)calloc(1, sizeof(YMF262_BATCH)))) return 0;
+  batch->lanes = lanes;
+  batch->chip = (YMF262 **)calloc(lanes, sizeof(YMF262 *));
+  batch->loaded = (uint8 *)calloc(lanes, sizeof(uint8));
+
+  /* bank, block buffers and masks in one piece */
+  p = (uint32 *)aligned_malloc((13 * slots + 2 * BATCH_BLOCK * slots +
+				4 * BATCH_BLOCK * lanes + 9 * YMF262_OP2 * lanes +
+				4 * lanes + (slots / 8 + 31) / 32) *
+			       sizeof(uint32));
+  batch->mem = p;
+
+  if(!batch->chip || !batch->loaded || !p) {
+    ymf262_batch_destroy(batch);
+    return 0;
+  }
+
+  bank = &batch->bank;
+  bank->slots = slots;
+  bank->phase = p; p += slots;
+  bank->omega = p; p += slots;
+  bank->env_att = p; p += slots;
+  bank->env_state = p; p += slots;
+  bank->arate = p; p += slots;
+  bank->drate = p; p += slots;
+  bank->srate = p; p += slots;
+  bank->rrate = p; p += slots;
+  bank->suslevel = p; p += slots;
+  bank->wave_neg = p; p += slots;
+  bank->wave_half = p; p += slots;
+  bank->wave_quarter = p; p += slots;
+  batch->att = p; p += slots;
+  batch->phase = p; p += BATCH_BLOCK * slots;
+  batch->env = p; p += BATCH_BLOCK * slots;
+  batch->mix = (int32 *)p; p += 4 * BATCH_BLOCK * lanes;
+  batch->car = p; p += 4 * YMF262_OP2 * lanes;
+  batch->am = p; p += 4 * YMF262_OP2 * lanes;
+  batch->fm = p; p += YMF262_OP2 * lanes;
+  batch->op1 = p; p += lanes;
+  batch->op2 = p; p += lanes;
+  batch->heard = p; p += lanes;
+  batch->amch = p; p += lanes;
+  batch->groups = p;
+
+  for(lane = 0; lane < lanes; lane++)
+    if(!(batch->chip[lane] = ymf262_create(channels, bits, rate))) {
+      ymf262_batch_destroy(batch);
+      return 0;
+    }
+
+  return batch;
+}
+
+void ymf262_batch_destroy(YMF262_BATCH *batch)
+{
+  uint32	lane;
+
+  if(batch->chip)
+    for(lane = 0; lane < batch->lanes; lane++)
+      if(batch->chip[lane]) ymf262_destroy(batch->chip[lane]);
+
+  aligned_free(batch->mem);
+  free(batch->loaded);
+  free(batch->chip);
+  free(batch);
+}
+
+void ymf262_batch_write(YMF262_BATCH *batch, uint32 lane, uint8 set,
+			uint8 index, uint8 data)
+{
+  /* dropped as in ymf262_write(), but for the timer control commands */
+  if(batch->chip[lane]->regs[set][index] == data && (set || index != 0x04))
+    return;
+  if(batch->loaded[lane]) lane_store(batch, lane);
+  ymf262_write(batch->chip[lane], set, index, data);
+}
+
+uint8 ymf262_batch_write_at(YMF262_BATCH *batch, uint32 lane, uint32 offset,
+			    uint8 set, uint8 index, uint8 data)
+{
+  return ymf262_write_at(batch->chip[lane], offset, set, index, data);
+}
+
+uint8 ymf262_batch_post(YMF262_BATCH *batch, uint32 lane, uint32 time,
+			uint8 set, uint8 index, uint8 data)
+{
+  return ymf262_post(batch->chip[lane], time, set, index, data);
+}
+
+void ymf262_batch_set_pull(YMF262_BATCH *batch, uint32 lane,
+			   ymf262_pull_fn pull, void *user)
+{
+  ymf262_set_pull(batch->chip[lane], pull, user);
+}
+
+void ymf262_batch_set_irq(YMF262_BATCH *batch, uint32 lane, ymf262_irq_fn irq,
+			  void *user)
+{
+  ymf262_set_irq(batch->chip[lane], irq, user);
+}
+
+uint8 ymf262_batch_set_quality(YMF262_BATCH *batch, uint8 quality)
+{
+  uint32	lane;
+
+  for(lane = 0; lane < batch->lanes; lane++)
+    if(!ymf262_set_quality(batch->chip[lane], quality)) return FALSE;
+
+  return TRUE;
+}
+
+uint8 ymf262_batch_set_pipeline(YMF262_BATCH *batch, uint8 pipeline)
+{
+  uint32	lane;
+
+  for(lane = 0; lane < batch->lanes; lane++)
+    if(!ymf262_set_pipeline(batch->chip[lane], pipeline)) return FALSE;
+
+  return TRUE;
+}
+
+void ymf262_batch_render(YMF262_BATCH *batch, void **buffers, uint32 length)
+{
+  YMF262	*opl = batch->chip[0];
+  int32		mix[4 * YMF262_BLOCK];
+  uint32	frame = opl->cfg_channels * (opl->cfg_bits / 8);
+  uint32	samples = length / frame, pos, n, m, lane;
+
+  for(pos = 0; pos < samples; pos += n) {
+    n = samples - pos < BATCH_BLOCK ? samples - pos : BATCH_BLOCK;
+
+    for(lane = 0; lane < batch->lanes; lane++) {
+      inbox_drain(batch->chip[lane]);
+      pull_run(batch->chip[lane], n);
+    }
+
+    if(!opl->rs.taps) {		/* running at the native rate */
+      n = batch_native(batch, n);
+
+      for(lane = 0; lane < batch->lanes; lane++) {
+	batch_lane(batch, lane, mix, n);
+	output(batch->chip[lane], mix, (uint8 *)buffers[lane] + pos * frame, n);
+	batch->chip[lane]->frames += n;
+      }
+      continue;
+    }
+
+    /* all resamplers run in lockstep, so the first one decides */
+    while(!resample_ready(opl)) {
+      m = resample_need(opl, n);
+      for(lane = 1; lane < batch->lanes; lane++)
+	resample_need(batch->chip[lane], n);
+      m = batch_native(batch, m < BATCH_BLOCK ? m : BATCH_BLOCK);
+
+      for(lane = 0; lane < batch->lanes; lane++) {
+	batch_lane(batch, lane, mix, m);
+	resample_in(batch->chip[lane], mix, m);
+      }
+    }
+
+    for(lane = 0; lane < batch->lanes; lane++) {
+      n = resample_out(batch->chip[lane], mix, n);
+      output(batch->chip[lane], mix, (uint8 *)buffers[lane] + pos * frame, n);
+      batch->chip[lane]->frames += n;
+    }
+  }
+}
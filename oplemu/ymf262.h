@@ -25,35 +25,239 @@
 extern "C" {
 #endif
 
-  typedef signed long		int32;
+  struct YMF262_SIMD;
+  typedef struct YMF262_BATCH YMF262_BATCH;
+
+  typedef signed int		int32;
   typedef signed short		int16;
   typedef signed char		int8;
-  typedef unsigned long		uint32;
+  typedef unsigned int		uint32;
   typedef unsigned short	uint16;
   typedef unsigned char		uint8;
 
+  /* Number of samples processed at a time by ymf262_render() */
+#define YMF262_BLOCK	64
+
+  /* Capacity of the timestamped register write queue (a power of 2) */
+#define YMF262_QUEUE	512
+
+  /*
+   * Operator slots: two halves of 24 slots (a multiple of 8 SIMD lanes),
+   * holding operator 1 and operator 2 of the 18 channels respectively.
+   */
+#define YMF262_OPSLOTS	48
+#define YMF262_OP2	24
+
+  /*
+   * Envelope generator states. Attenuations are in steps of 0.1875 dB,
+   * YMF262_EG_MAX is silent.
+   */
+#define YMF262_EG_ATTACK	0
+#define YMF262_EG_DECAY		1
+#define YMF262_EG_SUSTAIN	2
+#define YMF262_EG_RELEASE	3
+#define YMF262_EG_MAX		511
+
+  /* Capacity of the ring of writes from ymf262_post() (a power of 2) */
+#define YMF262_INBOX	1024
+
+  /* Resampling quality, see ymf262_set_quality() */
+#define YMF262_QUALITY_LOW	0
+#define YMF262_QUALITY_MEDIUM	1
+#define YMF262_QUALITY_HIGH	2
+
+  /* Operator output, see ymf262_set_pipeline() */
+#define YMF262_PIPELINE_LINEAR	0
+#define YMF262_PIPELINE_LOG	1
+
+  /* Longest resampling filter */
+#define YMF262_TAPS	32
+
+  /* Alignment of per-operator state arrays, and to a cache line */
+#ifdef __GNUC__
+#	define YMF262_ALIGN	__attribute__((aligned(32)))
+#	define YMF262_LINE	__attribute__((aligned(64)))
+#else
+#	define YMF262_ALIGN
+#	define YMF262_LINE
+#endif
+
+  /* Stages of the renderer, see ymf262_get_stats() */
+#define YMF262_STAGE_QUEUE	0	/* register writes applied */
+#define YMF262_STAGE_PHASOR	1	/* operator samples */
+#define YMF262_STAGE_ENVELOPE	2	/* operator samples */
+#define YMF262_STAGE_WAVEFORM	3	/* operator samples */
+#define YMF262_STAGE_MIX	4	/* samples of each output channel */
+#define YMF262_STAGE_RESAMPLE	5	/* samples of each output channel */
+#define YMF262_STAGE_OUTPUT	6	/* samples of each output channel */
+#define YMF262_STAGES		7
+
+  typedef struct {
+    /* CPU cycles spent in, and items processed by each stage */
+    unsigned long long	cycles[YMF262_STAGES], items[YMF262_STAGES];
+
+    /* Blocks rendered, and those of them with the whole chip silent */
+    unsigned long long	blocks, idle_blocks;
+
+    /* Active operators, and groups of 8 slots skipped, over all blocks */
+    unsigned long long	active_ops, skipped_groups;
+  } YMF262_STATS;
+
+  /* A register write, handed to the emulator by a ymf262_pull_fn */
+  typedef struct {
+    uint32	time;
+    uint8	set, index, data;
+  } YMF262_EVENT;
+
+  typedef void (*ymf262_irq_fn)(void *user, uint8 status);
+  /*
+   * Called when a timer raises the IRQ line of the chip, with the status
+   * register. It may write to the chip: the writes take effect at the
+   * very sample the timer overflowed.
+   */
+
+  typedef uint8 (*ymf262_pull_fn)(void *user, uint32 end, YMF262_EVENT *);
+  /*
+   * Called for the next register write that takes effect before output
+   * sample 'end', counted like the 'time' of ymf262_post(). Fills in the
+   * write and returns TRUE, or returns FALSE if there is none.
+   */
+
   typedef struct {
     /* Emulator configuration */
     uint8	cfg_channels, cfg_bits;
     uint32	cfg_rate;
 
-    /* Phasor */
-    int32	phasor_phi, phasor_omega;
+    /* OPL3 status register, and OPL3 mode (NEW bit of register 0x105) */
+    uint8	status, opl3;
 
-    /* OPL3 status register */
-    uint8	status;
+    /* Last value written to each register of both sets, as the chip has it */
+    uint8	regs[2][256];
 
-    /* 36 operators */
+    /* Native samples rendered so far, the time base of the write queue */
+    uint32	clock;
+
+    /* Output samples rendered so far, the time base of ymf262_post() */
+    uint32	frames;
+
+    /* Register writes queued by ymf262_write_at(), a ring sorted by time */
+    struct {
+      uint32	time;
+      uint8	set, index, data;
+    } queue[YMF262_QUEUE];
+    uint16	queue_head, queue_len;
+
+    /*
+     * Writes posted by ymf262_post(), on their way from the thread that
+     * posts them to the one that renders. Single producer, single
+     * consumer: only the producer moves 'inbox_tail', only the consumer
+     * 'inbox_head', each on its own cache line.
+     */
+    struct {
+      uint32	time;
+      uint8	set, index, data;
+    } inbox[YMF262_INBOX];
+    uint32	inbox_head YMF262_LINE;
+    uint32	inbox_tail YMF262_LINE;
+
+    /*
+     * Timers 1 and 2, running as set by register 0x04: the native sample
+     * each one overflows next. The IRQ callback set by ymf262_set_irq().
+     */
+    uint32	timer_due[2];
+    ymf262_irq_fn	irq;
+    void	*irq_user;
+
+    /* Source of register writes set by ymf262_set_pull(), or NULL */
+    ymf262_pull_fn	pull;
+    void	*pull_user;
+
+    /*
+     * Resampler from the native rate of the chip to cfg_rate: a polyphase
+     * FIR filter of 'taps' taps over the buffered native samples of each
+     * output channel. 'pos' is the position of the next output sample in
+     * 'in' and 'step' the distance between two, in 32.32 fixed point.
+     * 'taps' is 0 if cfg_rate is the native rate.
+     */
+    struct {
+      unsigned long long	pos, step;
+      uint32	fill, taps;
+      float	*coef;
+      float	in[4][YMF262_TAPS + YMF262_BLOCK] YMF262_ALIGN;
+    } rs;
+
+    /* SIMD kernels, selected by ymf262_create(), and operator pipeline */
+    const struct YMF262_SIMD *simd;
+    uint8	pipeline;
+
+    /*
+     * 36 operators, stored as one array per field so that each stage can
+     * process several operators at once. Slot 'ch' is the modulator
+     * (operator 1) and slot 'ch + YMF262_OP2' the carrier (operator 2) of
+     * channel 'ch'. Slots 18 - 23 and 42 - 47 are padding, always silent.
+     */
     struct {
-      /* ADSR */
-      uint32	env_level, env_shift, arate, drate, rrate, suslevel, bias;
-      uint8	attack;
+      /* Phasor, and its frequency multiplier (MULT of register 0x20) */
+      uint32	phase[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint32	omega[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint8	mult[YMF262_OPSLOTS];
+
+      /*
+       * Envelope generator: attenuation, state (YMF262_EG_...), the rate
+       * of each state and the sustain level. Rates are 4 times the
+       * register rate plus the key scale offset, 0 - 63, and 0 for a
+       * rate of 0, which never moves. 'srate' is the release rate, or 0
+       * if EGT holds the sustain level.
+       */
+      uint32	env_att[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint32	env_state[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint32	arate[YMF262_OPSLOTS], drate[YMF262_OPSLOTS];
+      uint32	srate[YMF262_OPSLOTS], rrate[YMF262_OPSLOTS];
+      uint32	suslevel[YMF262_OPSLOTS];
+      uint8	key[YMF262_OPSLOTS];
+
+      /* Rates as written, KSR and EGT, from which arate - rrate follow */
+      uint8	ar[YMF262_OPSLOTS], dr[YMF262_OPSLOTS], rr[YMF262_OPSLOTS];
+      uint8	ksr[YMF262_OPSLOTS], egt[YMF262_OPSLOTS];
+
+      /* Waveform, and its masks for phase quadrants 3 - 4 and 2 + 4 */
+      uint8	waveform[YMF262_OPSLOTS];
+      uint32	wave_neg[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint32	wave_half[YMF262_OPSLOTS] YMF262_ALIGN;
+      uint32	wave_quarter[YMF262_OPSLOTS] YMF262_ALIGN;
+    } op;
 
-      uint8	waveform;
-    } op[36];
+    /*
+     * Operators that are not silent: bit 'ch' of active[0] stands for
+     * operator 1, bit 'ch' of active[1] for operator 2 of channel 'ch'.
+     */
+    uint32	active[2];
 
-    /* 18 channels */
+    /*
+     * Operators with tremolo (AM) and vibrato (VIB) on, bits as in
+     * 'active', and the vibrato step of the LFO their speeds are for.
+     */
+    uint32	tremolo[2], vibrato[2];
+    uint8	vib_step;
+
+    /*
+     * Channels whose phasor speeds and envelope rates are out of date:
+     * register writes set bit 'ch', the next block brings them up to date.
+     */
+    uint32	dirty;
+
+    /* Render statistics, and the start of the stage being timed */
+    YMF262_STATS	stats;
+    unsigned long long	stats_mark;
+
+    /*
+     * 18 channels, 0 - 8 in the primary and 9 - 17 in the secondary set.
+     * Bit k of 'output' routes the channel to output k (A - D) in OPL3
+     * mode; OPL2 mode sends all channels to A and B.
+     */
     struct {
+      uint16	fnum;
+      uint8	block, connection, output;
     } channel[18];
   } YMF262;
 
@@ -63,17 +267,80 @@ extern "C" {
    * will output audio data using 'channels' audio channels, 'bits'
    * length samples and 'rate' Hz sampling rate.
    *
+   * 'channels' is 1 (mono: outputs A and B mixed), 2 (stereo: A left, B
+   * right) or 4 (outputs A - D). 'bits' is 8 (unsigned), 16 (signed,
+   * native byte order), 24 (signed, packed little endian) or 32 (float
+   * in [-1, 1)). All formats saturate at the range of 16 bit samples.
+   *
+   * The chip always runs at its native rate of 49716 Hz. Any other 'rate'
+   * of at least 1/32 of that is resampled, see ymf262_set_quality().
+   *
    * Returns a pointer to the initialized structure, or NULL if an
-   * error occured.
+   * error occured (including an unsupported format).
    */
 
   void ymf262_destroy(YMF262 *);
   /* Free the memory of the passed YMF262 data structure. */
 
+  uint32 ymf262_size(uint32 rate);
+  /*
+   * Returns the number of bytes ymf262_init_in() needs for a chip with
+   * sampling rate 'rate', resampling filter included.
+   */
+
+  YMF262 *ymf262_init_in(void *mem, uint8 channels, uint8 bits, uint32 rate);
+  /*
+   * Like ymf262_create(), but initializes the chip in 'mem', which must
+   * be ymf262_size(rate) bytes on a 64 byte boundary, instead of
+   * allocating memory. The chip owns no other memory: it is done with
+   * once 'mem' is reused, and must not be passed to ymf262_destroy().
+   *
+   * Returns 'mem' as a chip, or NULL if an error occured.
+   */
+
+  uint8 ymf262_set_quality(YMF262 *, uint8 quality);
+  /*
+   * Select the resampling filter: YMF262_QUALITY_LOW (8 taps),
+   * YMF262_QUALITY_MEDIUM (16 taps, the default) or YMF262_QUALITY_HIGH
+   * (32 taps). More taps cost more time, but keep more of the treble and
+   * less aliasing. Resets the resampler, so call it before rendering.
+   *
+   * Returns FALSE if an error occured, TRUE otherwise.
+   */
+
+  uint8 ymf262_set_pipeline(YMF262 *, uint8 pipeline);
+  /*
+   * Select how operators combine waveform and envelope:
+   * YMF262_PIPELINE_LINEAR (the default) multiplies the two, while
+   * YMF262_PIPELINE_LOG adds their attenuations in the log domain and
+   * looks the sum up in an exp table, like the real chip does. The log
+   * pipeline is closer to the real chip and needs no multiplies. Call it
+   * before rendering.
+   *
+   * Returns FALSE if an error occured, TRUE otherwise.
+   */
+
   void ymf262_render(YMF262 *, void *buffer, uint32 length);
   /*
    * Render audio data of a YMF262 data structure to a sample buffer,
-   * pointed to by 'buffer', with length 'length' bytes.
+   * pointed to by 'buffer', with length 'length' bytes. The buffer is
+   * processed in blocks of up to YMF262_BLOCK samples at a time, split
+   * only where queued register writes take effect. Channels are
+   * interleaved, in the format chosen with ymf262_create().
+   */
+
+  void ymf262_render_planar(YMF262 *, void **buffers, uint32 length);
+  /*
+   * Like ymf262_render(), but renders every output channel to its own
+   * buffer in 'buffers', each with length 'length' bytes.
+   */
+
+  void ymf262_skip(YMF262 *, uint32 samples);
+  /*
+   * Move on by 'samples' output samples without rendering them, much
+   * faster than rendering would. Queued and posted register writes are
+   * applied at their time as usual, and the following ymf262_render()
+   * goes on exactly as if the samples had been rendered.
    */
 
   void ymf262_write(YMF262 *, uint8 set, uint8 index, uint8 data);
@@ -82,10 +349,144 @@ extern "C" {
    * the primary or secondary register set (i.e. 0x888 and 0x389 or
    * 0x38a and 0x38b). 'index' is written to the index and 'data' to the
    * data register, respectively.
+   *
+   * Writes of the value a register already holds are dropped, so that
+   * only a change of the key on bit of register 0xb0 starts or releases
+   * the notes of a channel, as on the real chip. Writes to register 0x04
+   * are commands (IRQ reset, timer start) and are never dropped.
+   */
+
+  uint8 ymf262_write_at(YMF262 *, uint32 offset, uint8 set, uint8 index,
+			uint8 data);
+  /*
+   * Queues a write to the OPL3 registers, like ymf262_write(), to take
+   * effect 'offset' samples into the next ymf262_render() call. When
+   * resampling, it takes effect at the nearest native sample. Writes
+   * beyond the end of that call stay queued for the following ones.
+   * Writes with the same offset are applied in the order they were
+   * queued. ymf262_write() bypasses the queue and takes effect at once.
+   *
+   * Returns FALSE if the queue is full, TRUE otherwise.
+   */
+
+  uint8 ymf262_post(YMF262 *, uint32 time, uint8 set, uint8 index,
+		    uint8 data);
+  /*
+   * Posts a write to the OPL3 registers, to take effect at output sample
+   * 'time', counted from the creation of the chip (wrapping around at
+   * 2^32). Times already rendered take effect as soon as possible.
+   *
+   * Unlike all other functions, this one may be called while another
+   * thread renders the chip. It never blocks or waits, and neither does
+   * the renderer: it picks up posted writes at the start of each block.
+   * Only one thread at a time may post to a chip.
+   *
+   * Returns FALSE if too many writes are on their way, TRUE otherwise.
+   */
+
+  void ymf262_set_pull(YMF262 *, ymf262_pull_fn pull, void *user);
+  /*
+   * Have the chip ask 'pull' for its register writes, with 'user', right
+   * before it renders or skips samples: ymf262_render() then takes the
+   * writes for the samples it is about to render into the caller's
+   * buffer, one block at a time, whatever the length it is called with.
+   * Writes for samples already rendered take effect at once. Passing
+   * NULL stops asking.
+   */
+
+  uint8 ymf262_get_stats(const YMF262 *, YMF262_STATS *stats);
+  /*
+   * Copy the render statistics gathered since the chip was created or
+   * ymf262_reset_stats() was called into 'stats': the time stamp counter
+   * cycles and items of every stage (YMF262_STAGE_...), and how much of
+   * the chip sat idle. Chips in a batch only count queue and output.
+   *
+   * Statistics are only gathered if the library was built with
+   * YMF262_PROFILE defined, and cost nothing otherwise. Returns FALSE (and
+   * all zeros) if it was not, TRUE otherwise.
    */
 
+  void ymf262_reset_stats(YMF262 *);
+  /* Start over with the render statistics at 0. */
+
   uint8 ymf262_readstatus(YMF262 *);
-  /* Returns the contents of the OPL3 status register. */
+  /*
+   * Returns the contents of the OPL3 status register: bit 6 and 5 are
+   * set once timer 1 and 2 overflowed (unless masked), bit 7 along with
+   * either, until the flags are reset through register 0x04. Timers run
+   * in native samples, which lead the output by the resampling filter.
+   */
+
+  void ymf262_set_irq(YMF262 *, ymf262_irq_fn irq, void *user);
+  /*
+   * Have 'irq' called with 'user' whenever bit 7 of the status register
+   * goes from 0 to 1, only ever from within ymf262_render() and the like
+   * or ymf262_skip(). Passing NULL stops calling it. While it is set,
+   * blocks are split where the timers overflow, so that it is called at
+   * the exact sample.
+   */
+
+  YMF262_BATCH *ymf262_batch_create(uint32 lanes, uint8 channels, uint8 bits,
+				    uint32 rate);
+  /*
+   * Create a batch of 'lanes' independent chips, each configured like
+   * ymf262_create() does, that are rendered in one pass. The operator
+   * slots of all chips are interleaved, so every SIMD kernel call covers
+   * the same operator of several chips. 4, 8 or 16 lanes suit the
+   * kernels best, but any number works.
+   *
+   * It pays off for chips with few channels playing, whose operators a
+   * batch packs densely: with 2 channels each it renders about twice as
+   * fast as the chips one by one. From 6 channels on, a single chip
+   * fills its groups of slots as well, and a batch is about as fast.
+   *
+   * Returns a pointer to the batch, or NULL if an error occured.
+   */
+
+  void ymf262_batch_destroy(YMF262_BATCH *);
+  /* Free the batch and all of its chips. */
+
+  uint8 ymf262_batch_set_quality(YMF262_BATCH *, uint8 quality);
+  /* Select the resampling filter of all chips, like ymf262_set_quality(). */
+
+  uint8 ymf262_batch_set_pipeline(YMF262_BATCH *, uint8 pipeline);
+  /* Select the operator pipeline of all chips, like ymf262_set_pipeline(). */
+
+  void ymf262_batch_write(YMF262_BATCH *, uint32 lane, uint8 set,
+			  uint8 index, uint8 data);
+  /* Writes to the OPL3 registers of chip 'lane', like ymf262_write(). */
+
+  uint8 ymf262_batch_write_at(YMF262_BATCH *, uint32 lane, uint32 offset,
+			      uint8 set, uint8 index, uint8 data);
+  /*
+   * Queues a write to the OPL3 registers of chip 'lane', like
+   * ymf262_write_at(), relative to the next ymf262_batch_render() call.
+   *
+   * Returns FALSE if the queue is full, TRUE otherwise.
+   */
+
+  uint8 ymf262_batch_post(YMF262_BATCH *, uint32 lane, uint32 time,
+			  uint8 set, uint8 index, uint8 data);
+  /* Posts a write to chip 'lane' from another thread, see ymf262_post(). */
+
+  void ymf262_batch_set_pull(YMF262_BATCH *, uint32 lane,
+			     ymf262_pull_fn pull, void *user);
+  /* Have chip 'lane' ask 'pull' for its writes, see ymf262_set_pull(). */
+
+  void ymf262_batch_set_irq(YMF262_BATCH *, uint32 lane, ymf262_irq_fn irq,
+			    void *user);
+  /*
+   * Have 'irq' called for chip 'lane', see ymf262_set_irq(). It may write
+   * to the chip with ymf262_batch_write().
+   */
+
+  void ymf262_batch_render(YMF262_BATCH *, void **buffers, uint32 length);
+  /*
+   * Render the next 'length' bytes of every chip of the batch into the
+   * buffer at its lane in 'buffers', in the format of ymf262_render().
+   * Blocks are split where a queued register write of any chip takes
+   * effect.
+   */
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,297 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - streaming file output
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * The WAV header goes out with the first buffer, with zero sizes, and is
+ * written again over it on close. Samples are stored in the byte order
+ * of the host, so WAV files are only right on little endian machines.
+ *
+ * 16 bit and narrower mono and stereo get a plain PCM format chunk. The
+ * rest is WAVE_FORMAT_EXTENSIBLE with a channel mask, as Windows wants
+ * for 24 bit, float or more than 2 channels; float adds a fact chunk.
+ * An odd number of data bytes is padded to an even one on close.
+ *
+ * In mmap mode the file always ends with the mapped window: it is grown
+ * by a window at a time and cut back to what was rendered on close. The
+ * window is allocated on disk before it is mapped, so that a full disk
+ * is an error from the writer and not a SIGBUS from a store into it.
+ *
+ * Needs POSIX file I/O and mmap().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ymf262out.h"
+
+/***** Defines *****/
+
+/* Boolean values */
+#define TRUE	1
+#define FALSE	0
+
+/* Default buffer or window size in bytes */
+#define OUT_BUFFER	(256 * 1024)
+
+/*
+ * Largest RIFF WAVE header: a 40 byte WAVE_FORMAT_EXTENSIBLE format chunk
+ * and a fact chunk. A plain 16 byte format chunk makes it 44 bytes.
+ */
+#define WAV_HEADER	80
+
+/***** Types *****/
+
+struct YMF262_OUT {
+  YMF262	*opl;
+  int		fd;
+  uint8		format, error;
+  uint32	frame;		/* bytes per sample, all channels */
+  uint32	header;		/* bytes of WAV header, 0 for raw files */
+
+  /*
+   * The buffer, or the mapped window of the file at offset 'base'. The
+   * next sample goes to 'fill' bytes into it.
+   */
+  uint8		*buf;
+  uint32	size, fill;
+  unsigned long long	base;
+};
+
+/***** Implementation *****/
+
+static void put_le(uint8 *p, uint32 value, uint8 bytes)
+/* Store the low 'bytes' bytes of 'value' at 'p', little endian. */
+{
+  while(bytes--) { *p++ = (uint8)value; value >>= 8; }
+}
+
+static uint32 wav_header(const YMF262_OUT *out, uint8 *h,
+			 unsigned long long data)
+/*
+ * Build the WAV header for 'data' bytes of samples in 'h'. Returns its
+ * size in bytes.
+ */
+{
+  /* KSDATAFORMAT_SUBTYPE_PCM and _IEEE_FLOAT, but for the first 2 bytes */
+  static const uint8	guid[14] = {
+    0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+    0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+  };
+  static const uint8	mask[5] = { 0, 0x04, 0x03, 0, 0x33 };
+  YMF262	*opl = out->opl;
+  uint8		ext = opl->cfg_bits > 16 || opl->cfg_channels > 2;
+  uint8		tag = opl->cfg_bits == 32 ? 3 : 1;	/* float or PCM */
+  uint32	size = ext ? 68 : 44, pos = 36;
+
+  if(tag == 3) size += 12;
+  if(data > 0xfffffffe - size)	/* clamp beyond 4 GiB */
+    data = 0xfffffffe - size;
+
+  memcpy(h, "RIFF", 4);
+  put_le(h + 4, (uint32)(data + (data & 1)) + size - 8, 4);	/* padded */
+  memcpy(h + 8, "WAVEfmt ", 8); put_le(h + 16, ext ? 40 : 16, 4);
+  put_le(h + 20, ext ? 0xfffe : tag, 2);
+  put_le(h + 22, opl->cfg_channels, 2);
+  put_le(h + 24, opl->cfg_rate, 4);
+  put_le(h + 28, opl->cfg_rate * out->frame, 4);
+  put_le(h + 32, out->frame, 2);
+  put_le(h + 34, opl->cfg_bits, 2);
+
+  if(ext) {
+    put_le(h + 36, 22, 2);			/* extension size */
+    put_le(h + 38, opl->cfg_bits, 2);		/* valid bits */
+    put_le(h + 40, mask[opl->cfg_channels], 4);
+    put_le(h + 44, tag, 2); memcpy(h + 46, guid, 14);
+    pos = 60;
+  }
+
+  if(tag == 3) {				/* samples per channel */
+    memcpy(h + pos, "fact", 4); put_le(h + pos + 4, 4, 4);
+    put_le(h + pos + 8, (uint32)(data / out->frame), 4);
+    pos += 12;
+  }
+
+  memcpy(h + pos, "data", 4); put_le(h + pos + 4, (uint32)data, 4);
+  return size;
+}
+
+static uint8 write_all(int fd, const uint8 *p, uint32 length)
+/* write() all of 'length' bytes. Returns FALSE on an error. */
+{
+  ssize_t	n;
+
+  while(length) {
+    if((n = write(fd, p, length)) < 0) {
+      if(errno == EINTR) continue;
+      return FALSE;
+    }
+    p += n; length -= n;
+  }
+  return TRUE;
+}
+
+static uint8 flush(YMF262_OUT *out)
+/* Write out the buffer and empty it. */
+{
+  if(!write_all(out->fd, out->buf, out->fill)) out->error = TRUE;
+  out->base += out->fill;
+  out->fill = 0;
+  return !out->error;
+}
+
+static uint8 remap(YMF262_OUT *out)
+/*
+ * Map the next window of the file, starting at the page holding the
+ * next sample, and grow the file to its end, with the disk space
+ * allocated.
+ */
+{
+  unsigned long long	pos = out->base + out->fill;
+  unsigned long long	start = pos & ~(unsigned long long)
+    (sysconf(_SC_PAGESIZE) - 1);
+  void			*p;
+
+  if(out->buf) munmap(out->buf, out->size);
+  out->buf = 0;
+
+  if(posix_fallocate(out->fd, start, out->size) ||
+     (p = mmap(0, out->size, PROT_READ | PROT_WRITE, MAP_SHARED, out->fd,
+	       start)) == MAP_FAILED) {
+    out->error = TRUE;
+    return FALSE;
+  }
+
+  out->buf = (uint8 *)p;
+  out->base = start;
+  out->fill = pos - start;
+  return TRUE;
+}
+
+/***** Exported functions *****/
+
+YMF262_OUT *ymf262_out_open(YMF262 *opl, const char *filename, uint8 format,
+			    uint32 buffer)
+{
+  YMF262_OUT	*out;
+  uint32	page = sysconf(_SC_PAGESIZE);
+  uint8		header[WAV_HEADER];
+  void		*mem;
+
+  if((format & ~YMF262_OUT_MMAP) > YMF262_OUT_WAV) return 0;
+  if(!(out = (YMF262_OUT *)calloc(1, sizeof(YMF262_OUT)))) return 0;
+
+  out->opl = opl;
+  out->format = format;
+  out->frame = opl->cfg_channels * opl->cfg_bits / 8;
+  out->size = buffer ? buffer : OUT_BUFFER;
+
+  if((out->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0666)) < 0) {
+    free(out);
+    return 0;
+  }
+
+  if(format & YMF262_OUT_MMAP) {
+    /* whole pages, and room for a sample behind a partly used page */
+    out->size = (out->size + page - 1) / page * page;
+    if(out->size < 2 * page) out->size = 2 * page;
+
+    if((format & ~YMF262_OUT_MMAP) == YMF262_OUT_WAV) {
+      out->header = wav_header(out, header, 0);
+      out->error = !write_all(out->fd, header, out->header);
+      out->fill = out->header;
+    }
+    if(!out->error) remap(out);
+  } else {
+    /* whole samples, with the header in front of the first ones */
+    if(out->size < WAV_HEADER + out->frame)
+      out->size = WAV_HEADER + out->frame;
+    out->size -= out->size % out->frame;
+
+    if(posix_memalign(&mem, 64, out->size)) out->error = TRUE;
+    else out->buf = (uint8 *)mem;
+
+    if(out->buf && format == YMF262_OUT_WAV)
+      out->fill = out->header = wav_header(out, out->buf, 0);
+  }
+
+  if(out->error) {
+    if(!(format & YMF262_OUT_MMAP)) free(out->buf);
+    else if(out->buf) munmap(out->buf, out->size);
+    close(out->fd);
+    free(out);
+    return 0;
+  }
+
+  return out;
+}
+
+uint8 ymf262_out_render(YMF262_OUT *out, uint32 samples)
+{
+  uint32	n;
+
+  while(samples && !out->error) {
+    n = (out->size - out->fill) / out->frame;
+    if(!n) {
+      if(out->format & YMF262_OUT_MMAP) remap(out); else flush(out);
+      continue;
+    }
+    if(n > samples) n = samples;
+
+    ymf262_render(out->opl, out->buf + out->fill, n * out->frame);
+    out->fill += n * out->frame;
+    samples -= n;
+  }
+
+  return !out->error;
+}
+
+uint8 ymf262_out_close(YMF262_OUT *out)
+{
+  unsigned long long	length;
+  uint8			header[WAV_HEADER], ok;
+
+  if(out->format & YMF262_OUT_MMAP) {
+    if(out->buf) munmap(out->buf, out->size);
+  } else if(out->buf)
+    flush(out);
+  length = out->base + out->fill;
+
+  if(out->format & YMF262_OUT_MMAP && ftruncate(out->fd, length))
+    out->error = TRUE;
+
+  if((out->format & ~YMF262_OUT_MMAP) == YMF262_OUT_WAV) {
+    /* RIFF chunks have an even size, pad the data chunk if needed */
+    if((length - out->header) & 1 && pwrite(out->fd, "", 1, length) != 1)
+      out->error = TRUE;
+    wav_header(out, header, length - out->header);
+    if(pwrite(out->fd, header, out->header, 0) != out->header)
+      out->error = TRUE;
+  }
+
+  if(close(out->fd)) out->error = TRUE;
+  ok = !out->error;
+
+  if(!(out->format & YMF262_OUT_MMAP)) free(out->buf);
+  free(out);
+  return ok;
+}
@@ -0,0 +1,76 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - streaming file output
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef H_YMF262OUT
+#define H_YMF262OUT
+
+#include "ymf262.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct YMF262_OUT YMF262_OUT;
+
+  /* File formats, see ymf262_out_open() */
+#define YMF262_OUT_RAW	0
+#define YMF262_OUT_WAV	1
+
+  /* Flag for ymf262_out_open(): render into a mapping of the file */
+#define YMF262_OUT_MMAP	0x80
+
+  YMF262_OUT *ymf262_out_open(YMF262 *, const char *filename, uint8 format,
+			      uint32 buffer);
+  /*
+   * Create the file 'filename' and prepare to render the chip into it,
+   * in the sample format, channels and rate given to ymf262_create().
+   * 'format' is YMF262_OUT_RAW (headerless PCM) or YMF262_OUT_WAV (RIFF
+   * WAVE, its sizes filled in by ymf262_out_close()), optionally or'ed
+   * with YMF262_OUT_MMAP.
+   *
+   * Audio is rendered straight into a buffer of 'buffer' bytes, which is
+   * written to the file with a single call whenever it is full. With
+   * YMF262_OUT_MMAP the file is grown and mapped 'buffer' bytes at a
+   * time instead, and rendered into directly. Passing 0 uses 256 KiB.
+   *
+   * Returns a pointer to the writer, or NULL if an error occured.
+   */
+
+  uint8 ymf262_out_render(YMF262_OUT *, uint32 samples);
+  /*
+   * Render the next 'samples' samples of the chip, like ymf262_render()
+   * does, and append them to the file.
+   *
+   * Returns FALSE if the file could not be written, TRUE otherwise.
+   */
+
+  uint8 ymf262_out_close(YMF262_OUT *);
+  /*
+   * Write what is left in the buffer, complete the header, close the file
+   * and free the writer. The chip is not touched.
+   *
+   * Returns FALSE if an error occured at any time, TRUE otherwise.
+   */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - chip pool
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * Free slots form a stack, linked through 'next'. The top of the stack
+ * is packed into one 64 bit word with a counter in the high half that
+ * every change bumps, so a compare-and-swap cannot mistake a slot that
+ * was taken and given back in the meantime for an unchanged stack.
+ *
+ * Slots are whole pages: chips never share a cache line, and the first
+ * thread to touch a slot decides the NUMA node of all of it.
+ *
+ * Needs mmap() and gcc style atomic builtins.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ymf262pool.h"
+
+/***** Defines *****/
+
+/* Boolean values */
+#define TRUE	1
+#define FALSE	0
+
+/* Size of a cache line, to keep the top of the stack apart */
+#define CACHELINE	64
+
+/* End of the free slot stack */
+#define NONE	0xffffffff
+
+/* Pack and unpack the top of the free slot stack */
+#define TOP(count, slot)	((unsigned long long)(count) << 32 | (slot))
+#define TOP_COUNT(t)		((uint32)((t) >> 32))
+#define TOP_SLOT(t)		((uint32)(t))
+
+/***** Types *****/
+
+struct YMF262_POOL {
+  unsigned long long	top;		/* free slot stack */
+  char			pad[CACHELINE - sizeof(unsigned long long)];
+
+  uint8			*mem;
+  uint32		count, size;	/* slots, and bytes per slot */
+  uint32		*next;		/* slot below each free slot */
+};
+
+/***** Exported functions *****/
+
+YMF262_POOL *ymf262_pool_create(uint32 count)
+{
+  YMF262_POOL	*pool;
+  uint32	page = sysconf(_SC_PAGESIZE), i;
+  void		*mem;
+
+  if(!count) return 0;
+  if(posix_memalign(&mem, CACHELINE, sizeof(YMF262_POOL))) return 0;
+  pool = (YMF262_POOL *)mem;
+
+  /* big enough for a chip of any rate, in whole pages */
+  pool->size = (ymf262_size(0) + page - 1) / page * page;
+  pool->count = count;
+  pool->mem = (uint8 *)mmap(0, (size_t)count * pool->size,
+			    PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  pool->next = (uint32 *)malloc(count * sizeof(uint32));
+
+  if(pool->mem == MAP_FAILED || !pool->next) {
+    if(pool->mem != MAP_FAILED)
+      munmap(pool->mem, (size_t)count * pool->size);
+    free(pool->next); free(pool);
+    return 0;
+  }
+
+  /* all slots free, the first on top */
+  for(i = 0; i < count; i++) pool->next[i] = i + 1 < count ? i + 1 : NONE;
+  pool->top = TOP(0, 0);
+
+  return pool;
+}
+
+void ymf262_pool_destroy(YMF262_POOL *pool)
+{
+  munmap(pool->mem, (size_t)pool->count * pool->size);
+  free(pool->next);
+  free(pool);
+}
+
+YMF262 *ymf262_pool_get(YMF262_POOL *pool, uint8 channels, uint8 bits,
+			uint32 rate)
+{
+  unsigned long long	t = __atomic_load_n(&pool->top, __ATOMIC_ACQUIRE);
+  uint32		slot;
+  YMF262		*opl;
+
+  do {
+    if((slot = TOP_SLOT(t)) == NONE) return 0;	/* exhausted */
+  } while(!__atomic_compare_exchange_n(&pool->top, &t,
+				       TOP(TOP_COUNT(t) + 1,
+					   __atomic_load_n(&pool->next[slot],
+							   __ATOMIC_RELAXED)),
+				       TRUE, __ATOMIC_ACQ_REL,
+				       __ATOMIC_ACQUIRE));
+
+  opl = ymf262_init_in(pool->mem + (size_t)slot * pool->size, channels, bits,
+		       rate);
+  if(!opl) ymf262_pool_put(pool, (YMF262 *)(pool->mem +
+					     (size_t)slot * pool->size));
+  return opl;
+}
+
+void ymf262_pool_put(YMF262_POOL *pool, YMF262 *opl)
+{
+  uint32		slot = ((uint8 *)opl - pool->mem) / pool->size;
+  unsigned long long	t = __atomic_load_n(&pool->top, __ATOMIC_RELAXED);
+
+  do {
+    __atomic_store_n(&pool->next[slot], TOP_SLOT(t), __ATOMIC_RELAXED);
+  } while(!__atomic_compare_exchange_n(&pool->top, &t,
+				       TOP(TOP_COUNT(t) + 1, slot), TRUE,
+				       __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
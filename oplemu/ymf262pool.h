@@ -0,0 +1,68 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - chip pool
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef H_YMF262POOL
+#define H_YMF262POOL
+
+#include "ymf262.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct YMF262_POOL YMF262_POOL;
+
+  YMF262_POOL *ymf262_pool_create(uint32 count);
+  /*
+   * Reserve room for 'count' chips of any format in one piece of memory,
+   * each slot starting on a page of its own. The memory is not touched
+   * until a slot is first handed out, so each page ends up on the NUMA
+   * node of the thread that first initializes a chip in it.
+   *
+   * Returns a pointer to the pool, or NULL if an error occured.
+   */
+
+  void ymf262_pool_destroy(YMF262_POOL *);
+  /* Free the pool, along with all chips still in it. */
+
+  YMF262 *ymf262_pool_get(YMF262_POOL *, uint8 channels, uint8 bits,
+			  uint32 rate);
+  /*
+   * Initialize a chip, like ymf262_create() does, in a free slot of the
+   * pool. The most recently freed slot is used first, while it is still
+   * in the cache.
+   *
+   * Returns a pointer to the chip, or NULL if the pool is exhausted or
+   * an error occured.
+   */
+
+  void ymf262_pool_put(YMF262_POOL *, YMF262 *);
+  /* Give a chip from ymf262_pool_get() back to the pool. */
+
+  /*
+   * ymf262_pool_get() and ymf262_pool_put() may be called from several
+   * threads at once, and never block.
+   */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - multi-chip render scheduler
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * Every thread owns a range of chip indices, packed into one 64 bit
+ * word (first index in the low half, end in the high half). A thread
+ * takes chips off the front of its own range; once it is empty, it
+ * steals the back half of another thread's range. Both are a single
+ * compare-and-swap, so chips that take longer to render (more active
+ * operators, more queued writes) do not leave the other threads idle.
+ *
+ * Needs POSIX threads and gcc style atomic builtins.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ymf262sched.h"
+
+/***** Defines *****/
+
+/* Boolean values */
+#define TRUE	1
+#define FALSE	0
+
+/* Size of a cache line, to keep the ranges of the threads apart */
+#define CACHELINE	64
+
+/* Pack and unpack a range of chip indices */
+#define RANGE(first, end)	((unsigned long long)(end) << 32 | (first))
+#define RANGE_FIRST(r)		((uint32)(r))
+#define RANGE_END(r)		((uint32)((r) >> 32))
+
+/***** Types *****/
+
+typedef struct {
+  unsigned long long	range;		/* chips left to this thread */
+  char			pad[CACHELINE - sizeof(unsigned long long)];
+} WORKER;
+
+struct YMF262_SCHED {
+  uint32		threads;
+  pthread_t		*thread;	/* threads[0] is the caller's */
+  WORKER		*worker;
+
+  /* Hand-over between ymf262_sched_render() and the pool threads */
+  pthread_mutex_t	lock;
+  pthread_cond_t	start, done;
+  uint32		generation, busy;
+  uint8			quit;
+
+  /* The current batch */
+  YMF262		**chips;
+  void			**buffers;
+  uint32		length;
+  ymf262_done_fn	callback;
+  void			*user;
+};
+
+typedef struct {
+  YMF262_SCHED	*sched;
+  uint32	id;
+} THREADARG;
+
+/***** Implementation *****/
+
+static uint8 take(WORKER *w, uint32 *chip)
+/* Take the first chip off the range of 'w'. Returns FALSE if it is empty. */
+{
+  unsigned long long	r = __atomic_load_n(&w->range, __ATOMIC_ACQUIRE);
+
+  do {
+    if(RANGE_FIRST(r) >= RANGE_END(r)) return FALSE;
+  } while(!__atomic_compare_exchange_n(&w->range, &r,
+				       RANGE(RANGE_FIRST(r) + 1, RANGE_END(r)),
+				       TRUE, __ATOMIC_ACQ_REL,
+				       __ATOMIC_ACQUIRE));
+
+  *chip = RANGE_FIRST(r);
+  return TRUE;
+}
+
+static uint8 steal(WORKER *victim, WORKER *thief)
+/*
+ * Move the back half of the range of 'victim' to 'thief', whose own range
+ * is empty. Returns FALSE if there was nothing to steal.
+ */
+{
+  unsigned long long	r = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+  uint32		mid;
+
+  do {
+    if(RANGE_FIRST(r) >= RANGE_END(r)) return FALSE;
+    mid = RANGE_END(r) - (RANGE_END(r) - RANGE_FIRST(r) + 1) / 2;
+  } while(!__atomic_compare_exchange_n(&victim->range, &r,
+				       RANGE(RANGE_FIRST(r), mid), TRUE,
+				       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  __atomic_store_n(&thief->range, RANGE(mid, RANGE_END(r)), __ATOMIC_RELEASE);
+  return TRUE;
+}
+
+static void work(YMF262_SCHED *sched, uint32 id)
+/* Render chips until there are none left to take or steal. */
+{
+  uint32	chip, i;
+
+  for(;;) {
+    while(take(&sched->worker[id], &chip)) {
+      ymf262_render(sched->chips[chip], sched->buffers[chip], sched->length);
+      if(sched->callback)
+	sched->callback(sched->chips[chip], sched->buffers[chip], sched->user);
+    }
+
+    for(i = 1; i < sched->threads; i++)
+      if(steal(&sched->worker[(id + i) % sched->threads],
+	       &sched->worker[id]))
+	break;
+
+    if(i == sched->threads) return;	/* all ranges empty */
+  }
+}
+
+static void *thread_main(void *arg)
+/* Pool thread: wait for a batch, help rendering it, repeat. */
+{
+  YMF262_SCHED	*sched = ((THREADARG *)arg)->sched;
+  uint32	id = ((THREADARG *)arg)->id, seen = 0;
+  uint8		quit;
+
+  free(arg);
+
+  for(;;) {
+    pthread_mutex_lock(&sched->lock);
+    while(sched->generation == seen && !sched->quit)
+      pthread_cond_wait(&sched->start, &sched->lock);
+    seen = sched->generation;
+    quit = sched->quit;
+    pthread_mutex_unlock(&sched->lock);
+
+    if(quit) return 0;
+    work(sched, id);
+
+    pthread_mutex_lock(&sched->lock);
+    if(!--sched->busy) pthread_cond_signal(&sched->done);
+    pthread_mutex_unlock(&sched->lock);
+  }
+}
+
+/***** Exported functions *****/
+
+YMF262_SCHED *ymf262_sched_create(uint32 threads)
+{
+  YMF262_SCHED	*sched;
+  THREADARG	*arg;
+  void		*mem;
+  uint32	i;
+
+  if(!threads) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? cpus : 1;
+  }
+
+  if(!(sched = (YMF262_SCHED *)calloc(1, sizeof(YMF262_SCHED)))) return 0;
+  sched->threads = threads;
+  sched->thread = (pthread_t *)calloc(threads, sizeof(pthread_t));
+  if(posix_memalign(&mem, CACHELINE, threads * sizeof(WORKER))) mem = 0;
+  sched->worker = (WORKER *)mem;
+
+  if(!sched->thread || !sched->worker) {
+    free(sched->thread); free(sched->worker); free(sched);
+    return 0;
+  }
+
+  memset(sched->worker, 0, threads * sizeof(WORKER));
+  pthread_mutex_init(&sched->lock, 0);
+  pthread_cond_init(&sched->start, 0);
+  pthread_cond_init(&sched->done, 0);
+
+  for(i = 1; i < threads; i++) {
+    if(!(arg = (THREADARG *)malloc(sizeof(THREADARG)))) break;
+    arg->sched = sched; arg->id = i;
+    if(pthread_create(&sched->thread[i], 0, thread_main, arg)) {
+      free(arg);
+      break;
+    }
+  }
+
+  if(i < threads) {		/* could not start all threads */
+    sched->threads = i;
+    ymf262_sched_destroy(sched);
+    return 0;
+  }
+
+  return sched;
+}
+
+void ymf262_sched_destroy(YMF262_SCHED *sched)
+{
+  uint32	i;
+
+  pthread_mutex_lock(&sched->lock);
+  sched->quit = TRUE;
+  pthread_cond_broadcast(&sched->start);
+  pthread_mutex_unlock(&sched->lock);
+
+  for(i = 1; i < sched->threads; i++)
+    pthread_join(sched->thread[i], 0);
+
+  pthread_cond_destroy(&sched->done);
+  pthread_cond_destroy(&sched->start);
+  pthread_mutex_destroy(&sched->lock);
+  free(sched->worker);
+  free(sched->thread);
+  free(sched);
+}
+
+void ymf262_sched_render(YMF262_SCHED *sched, YMF262 **chips, void **buffers,
+			 uint32 count, uint32 length, ymf262_done_fn done,
+			 void *user)
+{
+  uint32	i;
+
+  sched->chips = chips;
+  sched->buffers = buffers;
+  sched->length = length;
+  sched->callback = done;
+  sched->user = user;
+
+  /* deal out equal ranges, stealing evens out the rest */
+  for(i = 0; i < sched->threads; i++)
+    sched->worker[i].range = RANGE((unsigned long long)count * i /
+				   sched->threads,
+				   (unsigned long long)count * (i + 1) /
+				   sched->threads);
+
+  pthread_mutex_lock(&sched->lock);
+  sched->busy = sched->threads - 1;
+  sched->generation++;
+  pthread_cond_broadcast(&sched->start);
+  pthread_mutex_unlock(&sched->lock);
+
+  work(sched, 0);
+
+  /* wait for the pool threads to finish their last chips */
+  pthread_mutex_lock(&sched->lock);
+  while(sched->busy)
+    pthread_cond_wait(&sched->done, &sched->lock);
+  pthread_mutex_unlock(&sched->lock);
+}
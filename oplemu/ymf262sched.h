@@ -0,0 +1,64 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - multi-chip render scheduler
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef H_YMF262SCHED
+#define H_YMF262SCHED
+
+#include "ymf262.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  typedef struct YMF262_SCHED YMF262_SCHED;
+
+  typedef void (*ymf262_done_fn)(YMF262 *, void *buffer, void *user);
+  /* Called on a pool thread as soon as a chip's buffer has been rendered. */
+
+  YMF262_SCHED *ymf262_sched_create(uint32 threads);
+  /*
+   * Create a thread pool of 'threads' threads, including the one calling
+   * ymf262_sched_render(). Passing 0 uses one thread per online CPU.
+   *
+   * Returns a pointer to the scheduler, or NULL if an error occured.
+   */
+
+  void ymf262_sched_destroy(YMF262_SCHED *);
+  /* Stop the pool threads and free the scheduler. */
+
+  void ymf262_sched_render(YMF262_SCHED *, YMF262 **chips, void **buffers,
+			   uint32 count, uint32 length, ymf262_done_fn done,
+			   void *user);
+  /*
+   * Render the next 'length' bytes of each of the 'count' chips in
+   * 'chips' into the buffer at the same position in 'buffers', like
+   * ymf262_render() does, spread over the pool. Register writes already
+   * queued with ymf262_write_at() are applied as usual. If 'done' is not
+   * NULL it is called with 'user' for every chip when it is finished.
+   *
+   * Returns when all chips are done. A chip must not be used by anything
+   * else until then.
+   */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,617 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - SIMD kernels
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * There is a plain C, an SSE2 and an AVX2 version of every kernel. The
+ * x86 versions are compiled with per-function target attributes, so the
+ * whole file builds without any -m flags and the choice is made at
+ * runtime by ymf262_simd_select(). Only gcc compatible compilers on x86
+ * get the vectorized kernels right now.
+ *
+ * The envelope kernel is plain C everywhere: a slot only does work on the
+ * samples where its envelope moves, and those differ from slot to slot.
+ *
+ * The waveform lookup is branch free: bit 30 of the phase mirrors the
+ * quarter sine table index, and the per-operator masks in wave_neg,
+ * wave_half and wave_quarter decide whether the 3rd and 4th quarter of
+ * the wave are negated or zeroed and whether the 2nd and 4th are zeroed.
+ *
+ * The log domain waveform kernels get the envelope attenuation from the
+ * envelope kernel, already in the 8.8 log2 units of the log-sin table,
+ * and add it as it is: no multiply and no conversion is left but the exp
+ * lookup. Silent envelopes give 32 or more octaves, and shifts by 32 or
+ * more give 0, as they do on AVX2.
+ *
+ * The resampling kernels sum the filter taps in 8 partial sums, which are
+ * then added up in the same order everywhere, so all versions give the
+ * same results.
+ */
+
+#include <math.h>
+
+#include "ymf262simd.h"
+#include "ymf262tab.h"
+
+/***** Defines *****/
+
+/* restrict qualifier for pointers to operator state arrays */
+#if defined(__GNUC__) || defined(_MSC_VER)
+#	define RESTRICT	__restrict
+#else
+#	define RESTRICT
+#endif
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#	define SIMD_X86
+#	define TARGET(x)	__attribute__((target(x)))
+#	include <immintrin.h>
+#endif
+
+/* Envelope attenuation -> level, 0 once it is off */
+#define EG_LEVEL(att)	((att) < YMF262_EG_MAX ?			\
+			 opl_eg_level[(att) & 31] >> ((att) >> 5) : 0)
+
+/* The same in log2 8.8 fixed point (a step is 1/32 octave), or the level */
+#define EG_LOG(att)	((att) < YMF262_EG_MAX ? (att) << 3 : 32 << 8)
+#define EG_OUT(att, log)	((log) ? EG_LOG(att) : EG_LEVEL(att))
+
+/* Saturate a mixed sample to 16 bits */
+#define CLIP16(x)	((x) > 32767 ? 32767 : ((x) < -32768 ? -32768 : (x)))
+
+/***** Plain C kernels *****/
+
+static void adsr_c(const YMF262_BANK *bank, uint32 *env, const uint32 *trem,
+		   uint8 log, uint32 clock, uint32 n, const uint32 *groups)
+/*
+ * Table driven envelope generator, as on the real chip: a slot moves only
+ * when the envelope counter is at a multiple of 2^opl_eg_shift[rate], by
+ * the increment the pattern of its rate has for that update. Attacks
+ * approach 0 by a fraction of what is left, the other states add to the
+ * attenuation. The block is filled with the levels (or attenuations) at
+ * its start a row at a time, then only the rows after an update are
+ * written again. Tremolo stays the same over a block, and is added to
+ * the attenuation as the real chip does.
+ */
+{
+  uint32	level[8], i, j, k, g, op, att, state, rate, inc, t = 0;
+  int32		a;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    if(env) {
+      for(k = 0; k < 8; k++)
+	level[k] = EG_OUT(bank->env_att[g * 8 + k] +
+			  (trem ? trem[g * 8 + k] : 0), log);
+      for(i = 0; i < n; i++)
+	for(k = 0; k < 8; k++) env[i * bank->slots + g * 8 + k] = level[k];
+    }
+
+    for(op = g * 8; op < g * 8 + 8; op++) {
+      att = bank->env_att[op];
+      state = bank->env_state[op];
+      if(trem) t = trem[op];
+
+      for(i = 0; i < n; i = j + 1) {
+	rate = state == YMF262_EG_ATTACK ? bank->arate[op] :
+	  state == YMF262_EG_DECAY ? bank->drate[op] :
+	  state == YMF262_EG_SUSTAIN ? bank->srate[op] : bank->rrate[op];
+
+	/* row of the next update, n if the envelope is at rest */
+	if(rate < 4 || (state != YMF262_EG_ATTACK && att >= YMF262_EG_MAX))
+	  j = n;
+	else {
+	  j = i + ((0 - (clock + i)) & ((1U << opl_eg_shift[rate]) - 1));
+	  if(j > n) j = n;
+	}
+
+	/* the level since the last update, which takes effect after its row */
+	if(env && i)
+	  for(k = i; k <= j && k < n; k++)
+	    env[k * bank->slots + op] = EG_OUT(att + t, log);
+	if(j == n) break;
+
+	inc = opl_eg_inc[rate * 8 + ((clock + j) >> opl_eg_shift[rate] & 7)];
+	switch(state) {
+	case YMF262_EG_ATTACK:
+	  a = (int32)att + ((~(int32)att * (int32)inc) >> 3);
+	  if(rate >= 60 || a <= 0) {		/* time to go to decay */
+	    att = 0;
+	    state = YMF262_EG_DECAY;
+	  } else
+	    att = a;
+	  break;
+	case YMF262_EG_DECAY:
+	  att += inc;
+	  if(att >= bank->suslevel[op]) state = YMF262_EG_SUSTAIN;
+	  break;
+	default:
+	  att += inc;
+	  if(att > YMF262_EG_MAX) att = YMF262_EG_MAX;
+	  break;
+	}
+      }
+
+      bank->env_att[op] = att;
+      bank->env_state[op] = state;
+    }
+  }
+}
+
+static void wave_c(const YMF262_BANK *bank, const int16 *sine,
+		   const uint32 *phase, const uint32 *env, int32 *out,
+		   uint32 n, const uint32 *groups)
+/*
+ * OPL2 waveform generator. Four waveforms are selectable:
+ *     __        __        __  __    _   _
+ *    /  \      /  \___   /  \/  \  / |_/ |_
+ *        \__/      
+ *
+ *     0:sine   1:sine>0  2:|sine|  3:chopped
+ */
+{
+  uint32	i, g, op, row, phi, neg, zero;
+  int32		q2, q3, y;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    for(i = 0, row = 0; i < n; i++, row += bank->slots)
+      for(op = g * 8; op < g * 8 + 8; op++) {
+	phi = phase[row + op];
+	q3 = (int32)phi >> 31;		/* all ones in 3rd and 4th quarter */
+	q2 = (int32)(phi << 1) >> 31;	/* all ones in 2nd and 4th quarter */
+
+	y = sine[((phi >> 21) ^ q2) & 511];	/* symmetry to 90 and 270 dgs */
+	neg = q3 & bank->wave_neg[op];
+	zero = (q3 & bank->wave_half[op]) | (q2 & bank->wave_quarter[op]);
+	y = ((y ^ neg) - neg) & ~zero;
+
+	out[row + op] = y * (int32)(env[row + op] >> 16);
+      }
+  }
+}
+
+static void wave_log_c(const YMF262_BANK *bank, const uint16 *logsin,
+		       const uint16 *pow2, const uint32 *phase,
+		       const uint32 *env, int32 *out, uint32 n,
+		       const uint32 *groups)
+{
+  uint32	i, g, op, row, phi, neg, zero, att, y;
+  int32		q2, q3;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    for(i = 0, row = 0; i < n; i++, row += bank->slots)
+      for(op = g * 8; op < g * 8 + 8; op++) {
+	phi = phase[row + op];
+	q3 = (int32)phi >> 31;
+	q2 = (int32)(phi << 1) >> 31;
+
+	att = logsin[((phi >> 22) ^ q2) & 255] + env[row + op];
+	y = att < 32 << 8 ? (uint32)pow2[att & 255] << 20 >> (att >> 8) : 0;
+
+	neg = q3 & bank->wave_neg[op];
+	zero = (q3 & bank->wave_half[op]) | (q2 & bank->wave_quarter[op]);
+	out[row + op] = ((y ^ neg) - neg) & ~zero;
+      }
+  }
+}
+
+static void mix_c(const int32 (*out)[YMF262_OPSLOTS], const uint32 *car,
+		  const uint32 *am, int32 *mix, uint32 n)
+{
+  uint32	i, ch;
+  int32		sum;
+
+  for(i = 0; i < n; i++) {
+    for(sum = 0, ch = 0; ch < YMF262_OP2; ch++)
+      sum += ((out[i][YMF262_OP2 + ch] >> 16) & car[ch]) +
+	((out[i][ch] >> 16) & am[ch]);
+    mix[i] = sum;
+  }
+}
+
+static void convert_c(const int32 *mix, void *out, uint32 n, uint8 bits)
+{
+  uint8		*p = (uint8 *)out;
+  uint32	i;
+  int32		s;
+
+  switch(bits) {
+  case 8:
+    for(i = 0; i < n; i++)
+      p[i] = (uint8)((CLIP16(mix[i]) >> 8) + 128);
+    break;
+  case 16:
+    for(i = 0; i < n; i++)
+      ((int16 *)out)[i] = CLIP16(mix[i]);
+    break;
+  case 24:
+    for(i = 0; i < n; i++, p += 3) {
+      s = CLIP16(mix[i]);
+      p[0] = 0; p[1] = (uint8)s; p[2] = (uint8)(s >> 8);
+    }
+    break;
+  case 32:
+    for(i = 0; i < n; i++)
+      ((float *)out)[i] = CLIP16(mix[i]) * (1.0f / 32768);
+    break;
+  }
+}
+
+static uint32 resample_c(const float *in, uint32 fill, const float *coef,
+			 uint32 taps, unsigned long long *pos,
+			 unsigned long long step, int32 *out, uint32 n)
+{
+  const float	*x, *h;
+  float		acc[8], t[4];
+  uint32	i, j, k;
+
+  for(i = 0; i < n && (*pos >> 32) + taps / 2 < fill; i++, *pos += step) {
+    x = in + (uint32)(*pos >> 32) + 1 - taps / 2;
+    h = coef + ((uint32)*pos >> 24) * taps;
+
+    for(j = 0; j < 8; j++) acc[j] = 0;
+    for(k = 0; k < taps; k += 8)
+      for(j = 0; j < 8; j++)
+	acc[j] += x[k + j] * h[k + j];
+
+    for(j = 0; j < 4; j++) t[j] = acc[j] + acc[j + 4];
+    out[i] = lrintf((t[0] + t[2]) + (t[1] + t[3]));
+  }
+
+  return i;
+}
+
+static const struct YMF262_SIMD simd_c = {
+  "c", adsr_c, wave_c, wave_log_c, mix_c, convert_c, resample_c
+};
+
+#ifdef SIMD_X86
+
+/***** SSE2 kernels *****/
+
+TARGET("sse2") static __m128i mullo_sse2(__m128i a, __m128i b)
+/* 32 bit multiply, keeping the low half. SSE2 only has 32 x 32 -> 64. */
+{
+  __m128i even = _mm_mul_epu32(a, b),
+    odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+TARGET("sse2") static void wave_sse2(const YMF262_BANK *bank,
+				     const int16 *sine, const uint32 *phase,
+				     const uint32 *env, int32 *out, uint32 n,
+				     const uint32 *groups)
+{
+  uint32	i, g, op, row, idx[4];
+  __m128i	phi, q2, q3, y, neg, zero;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    for(i = 0, row = 0; i < n; i++, row += bank->slots)
+      for(op = g * 8; op < g * 8 + 8; op += 4) {
+	phi = _mm_loadu_si128((const __m128i *)&phase[row + op]);
+	q3 = _mm_srai_epi32(phi, 31);
+	q2 = _mm_srai_epi32(_mm_slli_epi32(phi, 1), 31);
+
+	/* no gather in SSE2, so the table is read lane by lane */
+	_mm_storeu_si128((__m128i *)idx, _mm_and_si128(
+	  _mm_xor_si128(_mm_srli_epi32(phi, 21), q2), _mm_set1_epi32(511)));
+	y = _mm_setr_epi32(sine[idx[0]], sine[idx[1]], sine[idx[2]],
+			   sine[idx[3]]);
+
+	neg = _mm_and_si128(q3, _mm_loadu_si128((const __m128i *)
+						&bank->wave_neg[op]));
+	zero = _mm_or_si128(
+	  _mm_and_si128(q3, _mm_loadu_si128((const __m128i *)
+					    &bank->wave_half[op])),
+	  _mm_and_si128(q2, _mm_loadu_si128((const __m128i *)
+					    &bank->wave_quarter[op])));
+	y = _mm_andnot_si128(zero, _mm_sub_epi32(_mm_xor_si128(y, neg), neg));
+
+	_mm_storeu_si128((__m128i *)&out[row + op], mullo_sse2(y,
+	  _mm_srli_epi32(_mm_loadu_si128((const __m128i *)&env[row + op]), 16)));
+      }
+  }
+}
+
+TARGET("sse2") static void mix_sse2(const int32 (*out)[YMF262_OPSLOTS],
+				    const uint32 *car, const uint32 *am,
+				    int32 *mix, uint32 n)
+{
+  uint32	i, ch;
+  __m128i	sum, m;
+
+  for(i = 0; i < n; i++) {
+    sum = _mm_setzero_si128();
+
+    for(ch = 0; ch < YMF262_OP2; ch += 4) {
+      m = _mm_and_si128(_mm_srai_epi32(_mm_loadu_si128((const __m128i *)
+						       &out[i][ch]), 16),
+			_mm_loadu_si128((const __m128i *)&am[ch]));
+      sum = _mm_add_epi32(sum, _mm_add_epi32(m, _mm_and_si128(
+	_mm_srai_epi32(_mm_loadu_si128((const __m128i *)
+				       &out[i][YMF262_OP2 + ch]), 16),
+	_mm_loadu_si128((const __m128i *)&car[ch]))));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    mix[i] = _mm_cvtsi128_si32(sum);
+  }
+}
+
+TARGET("sse2") static void convert_sse2(const int32 *mix, void *out,
+					uint32 n, uint8 bits)
+/* Saturation comes from the 32 -> 16 bit pack. 24 bit is left to plain C. */
+{
+  uint32	i = 0;
+  __m128i	a, b;
+
+  switch(bits) {
+  case 8:
+    for(; i + 16 <= n; i += 16) {
+      a = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)&mix[i]),
+			  _mm_loadu_si128((const __m128i *)&mix[i + 4]));
+      b = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)&mix[i + 8]),
+			  _mm_loadu_si128((const __m128i *)&mix[i + 12]));
+      a = _mm_packs_epi16(_mm_srai_epi16(a, 8), _mm_srai_epi16(b, 8));
+      _mm_storeu_si128((__m128i *)((uint8 *)out + i),
+		       _mm_xor_si128(a, _mm_set1_epi8((char)0x80)));
+    }
+    break;
+  case 16:
+    for(; i + 8 <= n; i += 8)
+      _mm_storeu_si128((__m128i *)((int16 *)out + i), _mm_packs_epi32(
+	_mm_loadu_si128((const __m128i *)&mix[i]),
+	_mm_loadu_si128((const __m128i *)&mix[i + 4])));
+    break;
+  case 32:
+    for(; i + 4 <= n; i += 4) {
+      a = _mm_packs_epi32(_mm_loadu_si128((const __m128i *)&mix[i]),
+			  _mm_setzero_si128());
+      a = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);	/* back to 32 bit */
+      _mm_storeu_ps((float *)out + i, _mm_mul_ps(_mm_cvtepi32_ps(a),
+						 _mm_set1_ps(1.0f / 32768)));
+    }
+    break;
+  }
+
+  convert_c(mix + i, (uint8 *)out + i * (bits / 8), n - i, bits);
+}
+
+TARGET("sse2") static uint32 resample_sse2(const float *in, uint32 fill,
+					   const float *coef, uint32 taps,
+					   unsigned long long *pos,
+					   unsigned long long step, int32 *out,
+					   uint32 n)
+{
+  const float	*x, *h;
+  uint32	i, k;
+  __m128	lo, hi;
+
+  for(i = 0; i < n && (*pos >> 32) + taps / 2 < fill; i++, *pos += step) {
+    x = in + (uint32)(*pos >> 32) + 1 - taps / 2;
+    h = coef + ((uint32)*pos >> 24) * taps;
+
+    lo = hi = _mm_setzero_ps();
+    for(k = 0; k < taps; k += 8) {
+      lo = _mm_add_ps(lo, _mm_mul_ps(_mm_loadu_ps(x + k), _mm_loadu_ps(h + k)));
+      hi = _mm_add_ps(hi, _mm_mul_ps(_mm_loadu_ps(x + k + 4),
+				     _mm_loadu_ps(h + k + 4)));
+    }
+
+    lo = _mm_add_ps(lo, hi);
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    out[i] = _mm_cvtss_si32(_mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1)));
+  }
+
+  return i;
+}
+
+/*
+ * SSE2 has neither per-lane shifts nor gathers, so the envelope and the
+ * log domain waveform stay plain C
+ */
+static const struct YMF262_SIMD simd_sse2 = {
+  "sse2", adsr_c, wave_sse2, wave_log_c, mix_sse2, convert_sse2,
+  resample_sse2
+};
+
+/***** AVX2 kernels *****/
+
+TARGET("avx2") static void wave_avx2(const YMF262_BANK *bank,
+				     const int16 *sine, const uint32 *phase,
+				     const uint32 *env, int32 *out, uint32 n,
+				     const uint32 *groups)
+{
+  uint32	i, g, op;
+  __m256i	phi, q2, q3, y, neg, zero;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    for(i = 0, op = g * 8; i < n; i++, op += bank->slots) {
+      phi = _mm256_loadu_si256((const __m256i *)&phase[op]);
+      q3 = _mm256_srai_epi32(phi, 31);
+      q2 = _mm256_srai_epi32(_mm256_slli_epi32(phi, 1), 31);
+
+      /* 32 bit gather of 16 bit entries, then sign extend the low half */
+      y = _mm256_i32gather_epi32((const int *)sine, _mm256_and_si256(
+	_mm256_xor_si256(_mm256_srli_epi32(phi, 21), q2),
+	_mm256_set1_epi32(511)), 2);
+      y = _mm256_srai_epi32(_mm256_slli_epi32(y, 16), 16);
+
+      neg = _mm256_and_si256(q3, _mm256_loadu_si256((const __m256i *)
+						    &bank->wave_neg[g * 8]));
+      zero = _mm256_or_si256(
+	_mm256_and_si256(q3, _mm256_loadu_si256((const __m256i *)
+						&bank->wave_half[g * 8])),
+	_mm256_and_si256(q2, _mm256_loadu_si256((const __m256i *)
+						&bank->wave_quarter[g * 8])));
+      y = _mm256_andnot_si256(zero, _mm256_sub_epi32(
+	_mm256_xor_si256(y, neg), neg));
+
+      _mm256_storeu_si256((__m256i *)&out[op], _mm256_mullo_epi32(y,
+	_mm256_srli_epi32(_mm256_loadu_si256((const __m256i *)&env[op]), 16)));
+    }
+  }
+}
+
+TARGET("avx2") static void wave_log_avx2(const YMF262_BANK *bank,
+					 const uint16 *logsin,
+					 const uint16 *pow2,
+					 const uint32 *phase, const uint32 *env,
+					 int32 *out, uint32 n,
+					 const uint32 *groups)
+{
+  const __m256i	low8 = _mm256_set1_epi32(255);
+  const __m256i	low16 = _mm256_set1_epi32(0xffff);
+  uint32	i, g, op;
+  __m256i	phi, q2, q3, att, y, neg, zero;
+
+  for(g = 0; g < bank->slots / 8; g++) {
+    if(!YMF262_GROUP(groups, g)) continue;
+
+    for(i = 0, op = g * 8; i < n; i++, op += bank->slots) {
+      phi = _mm256_loadu_si256((const __m256i *)&phase[op]);
+      q3 = _mm256_srai_epi32(phi, 31);
+      q2 = _mm256_srai_epi32(_mm256_slli_epi32(phi, 1), 31);
+
+      /* 32 bit gathers of 16 bit entries, keeping the low half */
+      att = _mm256_and_si256(low16, _mm256_i32gather_epi32(
+	(const int *)logsin, _mm256_and_si256(
+	  _mm256_xor_si256(_mm256_srli_epi32(phi, 22), q2), low8), 2));
+      att = _mm256_add_epi32(att,
+			     _mm256_loadu_si256((const __m256i *)&env[op]));
+
+      y = _mm256_and_si256(low16, _mm256_i32gather_epi32(
+	(const int *)pow2, _mm256_and_si256(att, low8), 2));
+      y = _mm256_srlv_epi32(_mm256_slli_epi32(y, 20),
+			    _mm256_srli_epi32(att, 8));
+
+      neg = _mm256_and_si256(q3, _mm256_loadu_si256((const __m256i *)
+						    &bank->wave_neg[g * 8]));
+      zero = _mm256_or_si256(
+	_mm256_and_si256(q3, _mm256_loadu_si256((const __m256i *)
+						&bank->wave_half[g * 8])),
+	_mm256_and_si256(q2, _mm256_loadu_si256((const __m256i *)
+						&bank->wave_quarter[g * 8])));
+      _mm256_storeu_si256((__m256i *)&out[op], _mm256_andnot_si256(zero,
+	_mm256_sub_epi32(_mm256_xor_si256(y, neg), neg)));
+    }
+  }
+}
+
+TARGET("avx2") static void mix_avx2(const int32 (*out)[YMF262_OPSLOTS],
+				    const uint32 *car, const uint32 *am,
+				    int32 *mix, uint32 n)
+{
+  uint32	i, ch;
+  __m256i	sum, m;
+  __m128i	s;
+
+  for(i = 0; i < n; i++) {
+    sum = _mm256_setzero_si256();
+
+    for(ch = 0; ch < YMF262_OP2; ch += 8) {
+      m = _mm256_and_si256(_mm256_srai_epi32(_mm256_loadu_si256(
+	(const __m256i *)&out[i][ch]), 16),
+			   _mm256_loadu_si256((const __m256i *)&am[ch]));
+      sum = _mm256_add_epi32(sum, _mm256_add_epi32(m, _mm256_and_si256(
+	_mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)
+					     &out[i][YMF262_OP2 + ch]), 16),
+	_mm256_loadu_si256((const __m256i *)&car[ch]))));
+    }
+
+    s = _mm_add_epi32(_mm256_castsi256_si128(sum),
+		      _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    mix[i] = _mm_cvtsi128_si32(s);
+  }
+}
+
+TARGET("avx2") static uint32 resample_avx2(const float *in, uint32 fill,
+					   const float *coef, uint32 taps,
+					   unsigned long long *pos,
+					   unsigned long long step, int32 *out,
+					   uint32 n)
+{
+  const float	*x, *h;
+  uint32	i, k;
+  __m256	acc;
+  __m128	s;
+
+  for(i = 0; i < n && (*pos >> 32) + taps / 2 < fill; i++, *pos += step) {
+    x = in + (uint32)(*pos >> 32) + 1 - taps / 2;
+    h = coef + ((uint32)*pos >> 24) * taps;
+
+    acc = _mm256_setzero_ps();
+    for(k = 0; k < taps; k += 8)
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+					     _mm256_loadu_ps(h + k)));
+
+    s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    out[i] = _mm_cvtss_si32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+  }
+
+  return i;
+}
+
+/* Output conversion is bound by memory, AVX2 would not gain anything */
+static const struct YMF262_SIMD simd_avx2 = {
+  "avx2", adsr_c, wave_avx2, wave_log_avx2, mix_avx2, convert_sse2,
+  resample_avx2
+};
+
+#endif
+
+/***** Exported functions *****/
+
+const struct YMF262_SIMD *ymf262_simd_select(void)
+{
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return &simd_avx2;
+  if(__builtin_cpu_supports("sse2")) return &simd_sse2;
+#endif
+
+  return &simd_c;
+}
+
+const struct YMF262_SIMD *ymf262_simd_get(uint32 i)
+{
+  if(!i) return &simd_c;
+
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if(i == 1 && __builtin_cpu_supports("sse2")) return &simd_sse2;
+  if(i == 2 && __builtin_cpu_supports("avx2")) return &simd_avx2;
+#endif
+
+  return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - SIMD kernels
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef H_YMF262SIMD
+#define H_YMF262SIMD
+
+#include "ymf262.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /*
+   * A bank of operator slots, stored as one array per field, and block
+   * buffers of 'slots' entries per row, one row per sample. A chip is a
+   * bank of YMF262_OPSLOTS slots; ymf262_batch_create() interleaves the
+   * slots of several chips into one bank.
+   */
+  typedef struct {
+    uint32	slots;		/* a multiple of 8 */
+    uint32	*phase, *omega;
+    uint32	*env_att, *env_state;
+    uint32	*arate, *drate, *srate, *rrate, *suslevel;
+    uint32	*wave_neg, *wave_half, *wave_quarter;
+  } YMF262_BANK;
+
+  /*
+   * Slots are processed in groups of 8, the widest vector. Bit 'g % 32' of
+   * word 'g / 32' of a 'groups' mask selects slots 8g - 8g + 7. Slots not
+   * selected keep their state, and their block buffer entries are left
+   * undefined.
+   */
+#define YMF262_GROUP(groups, g)	((groups)[(g) >> 5] & (1U << ((g) & 31)))
+
+  /* Phases of the resampling filter, selected by the top 8 fraction bits */
+#define YMF262_PHASES	256
+
+  /* Inner loop kernels of the renderer, working on 'n' rows at a time. */
+  struct YMF262_SIMD {
+    const char	*name;
+
+    void (*adsr)(const YMF262_BANK *, uint32 *env, const uint32 *trem,
+		 uint8 log, uint32 clock, uint32 n, const uint32 *groups);
+    /*
+     * Get the next 'n' envelope levels of the slots in 'groups' into
+     * 'env', the first one at sample 'clock' of the envelope counter, or
+     * just move the envelopes on if 'env' is NULL. The tremolo
+     * attenuation of each slot in 'trem', if not NULL, is added to that
+     * of its envelope. If 'log' is TRUE, 'env' gets the attenuations
+     * instead, for 'wave_log'.
+     */
+
+    void (*wave)(const YMF262_BANK *, const int16 *sine, const uint32 *phase,
+		 const uint32 *env, int32 *out, uint32 n,
+		 const uint32 *groups);
+    /*
+     * Waveform lookup of the slots in 'groups', scaled by their envelope
+     * levels. 'sine' is the quarter sine table, with one entry of
+     * padding. 'out' may be 'env'.
+     */
+
+    void (*wave_log)(const YMF262_BANK *, const uint16 *logsin,
+		     const uint16 *pow2, const uint32 *phase,
+		     const uint32 *env, int32 *out, uint32 n,
+		     const uint32 *groups);
+    /*
+     * The same as 'wave', the way the real chip does it: the log-sin
+     * attenuation and the envelope attenuation in 'env' are added, and
+     * turned into a level by the exp table 'pow2'. Both tables have one
+     * entry of padding.
+     */
+
+    void (*mix)(const int32 (*out)[YMF262_OPSLOTS], const uint32 *car,
+		const uint32 *am, int32 *mix, uint32 n);
+    /*
+     * Channel mix of a single chip: sums those operator 2 outputs whose
+     * mask in 'car' is set, plus those operator 1 outputs whose mask in
+     * 'am' is set, into 'mix'.
+     */
+
+    void (*convert)(const int32 *mix, void *out, uint32 n, uint8 bits);
+    /*
+     * Saturate 'n' mixed samples to 16 bits and store them in 'out' as
+     * 'bits' bit samples: unsigned 8 bit, signed 16 bit, packed little
+     * endian 24 bit or 32 bit float in [-1, 1).
+     */
+
+    uint32 (*resample)(const float *in, uint32 fill, const float *coef,
+		       uint32 taps, unsigned long long *pos,
+		       unsigned long long step, int32 *out, uint32 n);
+    /*
+     * Polyphase FIR resampling of the 'fill' samples in 'in' into up to
+     * 'n' samples in 'out', from position '*pos' on in steps of 'step'
+     * (both 32.32 fixed point). 'coef' holds YMF262_PHASES rows of 'taps'
+     * coefficients, 'taps' is a multiple of 8. Stops when the input runs
+     * short, advances '*pos' and returns the number of samples done.
+     */
+  };
+
+  const struct YMF262_SIMD *ymf262_simd_select(void);
+  /* Returns the fastest kernels the executing CPU supports. */
+
+  const struct YMF262_SIMD *ymf262_simd_get(uint32 i);
+  /*
+   * Returns the 'i'th set of kernels the executing CPU supports, plain C
+   * first, or NULL if there are no more. All sets give the same output,
+   * which Check.cpp makes sure of.
+   */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
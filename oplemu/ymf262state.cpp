@@ -0,0 +1,217 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - state snapshots
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * NOTES:
+ * A snapshot is the tag "YMF", a version byte and the state in the byte
+ * order binio is set to. Only the 36 real operators are stored, without
+ * what follows from their registers: the phasor speeds and envelope rates
+ * are brought up to date by the next block, the waveform masks right
+ * away. The resampler history is stored as integers, which is all it
+ * ever holds.
+ */
+
+#include "ymf262state.h"
+
+/***** Defines *****/
+
+/* Boolean values */
+#define TRUE	1
+#define FALSE	0
+
+/* Snapshot format version */
+#define STATE_VERSION	6
+
+/*
+ * Native samples by which queued writes and running timers may be due
+ * before the clock: a block renders past the timers without an IRQ
+ * callback, and writes queued while resampling go back to the front edge
+ * of the filter.
+ */
+#define STATE_LATE	(YMF262_TAPS + YMF262_BLOCK)
+
+/***** Implementation *****/
+
+static uint8 slot_of(uint8 i)
+/* Slot of operator 'i' (0 - 35), skipping the padding slots. */
+{
+  return i < 18 ? i : i - 18 + YMF262_OP2;
+}
+
+static uint8 time_ok(const YMF262 *opl, uint32 time)
+/* Returns TRUE if 'time' is not further back than STATE_LATE samples. */
+{
+  return (int32)(time - opl->clock) >= -STATE_LATE;
+}
+
+/***** Exported functions *****/
+
+uint8 ymf262_save_state(const YMF262 *opl, binostream &out)
+{
+  uint32	i, k;
+  uint8		op;
+
+  out.writeByte('Y'); out.writeByte('M'); out.writeByte('F');
+  out.writeByte(STATE_VERSION);
+
+  /* the resampler history only fits a chip of the same rate and quality */
+  out.writeDWord(opl->cfg_rate);
+  out.writeByte(opl->rs.taps);
+
+  out.writeByte(opl->status); out.writeByte(opl->opl3);
+  out.writeDWord(opl->clock); out.writeDWord(opl->frames);
+
+  for(k = 0; k < 2; k++)
+    for(i = 0; i < 256; i++) out.writeByte(opl->regs[k][i]);
+  out.writeDWord(opl->timer_due[0]); out.writeDWord(opl->timer_due[1]);
+
+  out.writeWord(opl->queue_len);
+  for(i = 0; i < opl->queue_len; i++) {
+    k = (opl->queue_head + i) & (YMF262_QUEUE - 1);
+    out.writeDWord(opl->queue[k].time);
+    out.writeByte(opl->queue[k].set);
+    out.writeByte(opl->queue[k].index);
+    out.writeByte(opl->queue[k].data);
+  }
+
+  if(opl->rs.taps) {
+    out.writeQWord(opl->rs.pos);
+    out.writeByte(opl->rs.fill);
+    for(k = 0; k < opl->cfg_channels; k++)
+      for(i = 0; i < opl->rs.fill; i++)
+	out.writeDWord((int32)opl->rs.in[k][i]);
+  }
+
+  for(i = 0; i < 36; i++) {
+    op = slot_of(i);
+    out.writeDWord(opl->op.phase[op]);
+    out.writeWord(opl->op.env_att[op]);
+    out.writeWord(opl->op.suslevel[op]);
+    out.writeByte(opl->op.ar[op] << 4 | opl->op.dr[op]);
+    out.writeByte(opl->op.rr[op]);
+    k = op % YMF262_OP2;
+    out.writeByte((opl->tremolo[op / YMF262_OP2] >> k & 1) << 7 |
+		  (opl->vibrato[op / YMF262_OP2] >> k & 1) << 6 |
+		  opl->op.egt[op] << 5 | opl->op.ksr[op] << 4 |
+		  opl->op.mult[op]);
+    out.writeByte(opl->op.env_state[op] << 1 | opl->op.key[op]);
+    out.writeByte(opl->op.waveform[op]);
+  }
+
+  out.writeDWord(opl->active[0]); out.writeDWord(opl->active[1]);
+
+  for(i = 0; i < 18; i++) {
+    out.writeWord(opl->channel[i].fnum);
+    out.writeByte(opl->channel[i].block);
+    out.writeByte(opl->channel[i].connection);
+    out.writeByte(opl->channel[i].output);
+  }
+
+  return TRUE;
+}
+
+uint8 ymf262_load_state(YMF262 *opl, binistream &in)
+{
+  uint32	i, k;
+  uint8		op, flags;
+
+  if(in.readByte() != 'Y' || in.readByte() != 'M' || in.readByte() != 'F' ||
+     in.readByte() != STATE_VERSION)
+    return FALSE;
+
+  if((uint32)in.readDWord() != opl->cfg_rate ||
+     (uint8)in.readByte() != opl->rs.taps)
+    return FALSE;
+
+  opl->status = in.readByte(); opl->opl3 = in.readByte();
+  opl->clock = in.readDWord(); opl->frames = in.readDWord();
+
+  for(k = 0; k < 2; k++)
+    for(i = 0; i < 256; i++) opl->regs[k][i] = in.readByte();
+  opl->timer_due[0] = in.readDWord(); opl->timer_due[1] = in.readDWord();
+  for(k = 0; k < 2; k++)
+    if(opl->regs[0][4] & (1 << k) && !time_ok(opl, opl->timer_due[k]))
+      return FALSE;
+
+  /* in time order, to registers that exist */
+  opl->queue_head = 0;
+  opl->queue_len = in.readWord();
+  if(opl->queue_len > YMF262_QUEUE) return FALSE;
+  for(i = 0; i < opl->queue_len; i++) {
+    opl->queue[i].time = in.readDWord();
+    opl->queue[i].set = in.readByte();
+    opl->queue[i].index = in.readByte();
+    opl->queue[i].data = in.readByte();
+    if(opl->queue[i].set > 1 || !time_ok(opl, opl->queue[i].time) ||
+       (i && (int32)(opl->queue[i].time - opl->queue[i - 1].time) < 0))
+      return FALSE;
+  }
+
+  if(opl->rs.taps) {
+    opl->rs.pos = in.readQWord();
+    opl->rs.fill = (uint8)in.readByte();
+    if(opl->rs.fill > YMF262_TAPS + YMF262_BLOCK ||
+       (opl->rs.pos >> 32) > YMF262_TAPS + YMF262_BLOCK)
+      return FALSE;
+    for(k = 0; k < opl->cfg_channels; k++)
+      for(i = 0; i < opl->rs.fill; i++)
+	opl->rs.in[k][i] = (float)(int32)in.readDWord();
+  }
+
+  opl->tremolo[0] = opl->tremolo[1] = opl->vibrato[0] = opl->vibrato[1] = 0;
+  for(i = 0; i < 36; i++) {
+    op = slot_of(i);
+    opl->op.phase[op] = in.readDWord();
+    opl->op.env_att[op] = in.readWord();
+    opl->op.suslevel[op] = in.readWord();
+    if(opl->op.env_att[op] > YMF262_EG_MAX ||
+       opl->op.suslevel[op] > YMF262_EG_MAX)
+      return FALSE;
+    flags = in.readByte();
+    opl->op.ar[op] = (flags >> 4) & 15;
+    opl->op.dr[op] = flags & 15;
+    opl->op.rr[op] = in.readByte() & 15;
+    flags = in.readByte();
+    k = op % YMF262_OP2;
+    opl->tremolo[op / YMF262_OP2] |= (uint32)(flags >> 7 & 1) << k;
+    opl->vibrato[op / YMF262_OP2] |= (uint32)(flags >> 6 & 1) << k;
+    opl->op.egt[op] = (flags >> 5) & 1;
+    opl->op.ksr[op] = (flags >> 4) & 1;
+    opl->op.mult[op] = flags & 15;
+    flags = in.readByte();
+    opl->op.env_state[op] = (flags >> 1) & 3;
+    opl->op.key[op] = flags & 1;
+    opl->op.waveform[op] = in.readByte() & 3;
+    opl->op.wave_neg[op] = opl->op.waveform[op] == 0 ? ~0 : 0;
+    opl->op.wave_half[op] = opl->op.waveform[op] & 1 ? ~0 : 0;
+    opl->op.wave_quarter[op] = opl->op.waveform[op] == 3 ? ~0 : 0;
+  }
+
+  opl->active[0] = in.readDWord(); opl->active[1] = in.readDWord();
+
+  for(i = 0; i < 18; i++) {
+    opl->channel[i].fnum = in.readWord() & 0x3ff;
+    opl->channel[i].block = in.readByte() & 7;
+    opl->channel[i].connection = in.readByte() & 1;
+    opl->channel[i].output = in.readByte() & 15;
+  }
+
+  opl->dirty = (1 << 18) - 1;
+
+  return !in.eof();
+}
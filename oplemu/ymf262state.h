@@ -0,0 +1,48 @@
+/*
+ * Yamaha YMF262 (OPL3) emulator - state snapshots
+ * Copyright (C) 2002 Volker Gietz <talphir@web.de>
+ * Copyright (C) 2002 Simon Peter <dn.tlp@gmx.net>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef H_YMF262STATE
+#define H_YMF262STATE
+
+#include "binio.h"
+#include "ymf262.h"
+
+  uint8 ymf262_save_state(const YMF262 *, binostream &out);
+  /*
+   * Write a snapshot of the emulated chip to 'out': channels, operators
+   * in whatever phase of their envelopes they are, queued register
+   * writes and the resampler history. Writes posted by ymf262_post()
+   * that the chip has not picked up yet are not part of it.
+   *
+   * Returns FALSE if an error occured, TRUE otherwise.
+   */
+
+  uint8 ymf262_load_state(YMF262 *, binistream &in);
+  /*
+   * Restore a snapshot written by ymf262_save_state(), so that the chip
+   * goes on rendering exactly where the saved one was. The chip must have
+   * been created with the same sampling rate and set to the same quality.
+   * Writes posted to it are kept.
+   *
+   * Returns FALSE if the snapshot is damaged or does not fit the chip,
+   * leaving the chip in an undefined state. Returns TRUE otherwise.
+   */
+
+#endif
@@ -0,0 +1,252 @@
+/* Generated by mktables.c - do not edit. */
+
+#ifndef H_YMF262TAB
+#define H_YMF262TAB
+
+/* first quarter of a sine wave, 1 entry padding */
+static const short opl_sine[512 + 1] = {
+      0,   100,   201,   301,   402,   502,   603,   703,
+    804,   904,  1005,  1105,  1206,  1306,  1406,  1507,
+   1607,  1708,  1808,  1908,  2009,  2109,  2209,  2310,
+   2410,  2510,  2610,  2711,  2811,  2911,  3011,  3111,
+   3211,  3311,  3411,  3511,  3611,  3711,  3811,  3911,
+   4011,  4110,  4210,  4310,  4409,  4509,  4608,  4708,
+   4807,  4907,  5006,  5106,  5205,  5304,  5403,  5502,
+   5601,  5700,  5799,  5898,  5997,  6096,  6195,  6293,
+   6392,  6491,  6589,  6688,  6786,  6884,  6982,  7081,
+   7179,  7277,  7375,  7473,  7571,  7668,  7766,  7864,
+   7961,  8059,  8156,  8253,  8351,  8448,  8545,  8642,
+   8739,  8836,  8932,  9029,  9126,  9222,  9319,  9415,
+   9511,  9607,  9703,  9799,  9895,  9991, 10087, 10182,
+  10278, 10373, 10469, 10564, 10659, 10754, 10849, 10944,
+  11038, 11133, 11227, 11322, 11416, 11510, 11604, 11698,
+  11792, 11886, 11980, 12073, 12166, 12260, 12353, 12446,
+  12539, 12632, 12724, 12817, 12909, 13002, 13094, 13186,
+  13278, 13370, 13462, 13553, 13645, 13736, 13827, 13918,
+  14009, 14100, 14191, 14281, 14372, 14462, 14552, 14642,
+  14732, 14822, 14911, 15001, 15090, 15179, 15268, 15357,
+  15446, 15534, 15623, 15711, 15799, 15887, 15975, 16063,
+  16150, 16238, 16325, 16412, 16499, 16586, 16672, 16759,
+  16845, 16931, 17017, 17103, 17189, 17274, 17360, 17445,
+  17530, 17615, 17699, 17784, 17868, 17952, 18036, 18120,
+  18204, 18287, 18371, 18454, 18537, 18620, 18702, 18785,
+  18867, 18949, 19031, 19113, 19194, 19276, 19357, 19438,
+  19519, 19599, 19680, 19760, 19840, 19920, 20000, 20079,
+  20159, 20238, 20317, 20396, 20474, 20553, 20631, 20709,
+  20787, 20864, 20942, 21019, 21096, 21173, 21249, 21326,
+  21402, 21478, 21554, 21629, 21705, 21780, 21855, 21930,
+  22004, 22079, 22153, 22227, 22301, 22374, 22448, 22521,
+  22594, 22666, 22739, 22811, 22883, 22955, 23027, 23098,
+  23169, 23240, 23311, 23382, 23452, 23522, 23592, 23661,
+  23731, 23800, 23869, 23938, 24006, 24075, 24143, 24211,
+  24278, 24346, 24413, 24480, 24546, 24613, 24679, 24745,
+  24811, 24877, 24942, 25007, 25072, 25136, 25201, 25265,
+  25329, 25392, 25456, 25519, 25582, 25645, 25707, 25769,
+  25831, 25893, 25954, 26016, 26077, 26137, 26198, 26258,
+  26318, 26378, 26437, 26497, 26556, 26615, 26673, 26731,
+  26789, 26847, 26905, 26962, 27019, 27076, 27132, 27188,
+  27244, 27300, 27355, 27411, 27466, 27520, 27575, 27629,
+  27683, 27736, 27790, 27843, 27896, 27948, 28001, 28053,
+  28105, 28156, 28208, 28259, 28309, 28360, 28410, 28460,
+  28510, 28559, 28608, 28657, 28706, 28754, 28802, 28850,
+  28897, 28945, 28992, 29038, 29085, 29131, 29177, 29222,
+  29268, 29313, 29358, 29402, 29446, 29490, 29534, 29577,
+  29621, 29663, 29706, 29748, 29790, 29832, 29873, 29915,
+  29955, 29996, 30036, 30076, 30116, 30156, 30195, 30234,
+  30272, 30311, 30349, 30386, 30424, 30461, 30498, 30535,
+  30571, 30607, 30643, 30678, 30713, 30748, 30783, 30817,
+  30851, 30885, 30918, 30951, 30984, 31017, 31049, 31081,
+  31113, 31144, 31175, 31206, 31236, 31267, 31297, 31326,
+  31356, 31385, 31413, 31442, 31470, 31498, 31525, 31553,
+  31580, 31606, 31633, 31659, 31684, 31710, 31735, 31760,
+  31785, 31809, 31833, 31856, 31880, 31903, 31926, 31948,
+  31970, 31992, 32014, 32035, 32056, 32077, 32097, 32117,
+  32137, 32156, 32176, 32194, 32213, 32231, 32249, 32267,
+  32284, 32301, 32318, 32334, 32350, 32366, 32382, 32397,
+  32412, 32426, 32441, 32455, 32468, 32482, 32495, 32508,
+  32520, 32532, 32544, 32556, 32567, 32578, 32588, 32599,
+  32609, 32618, 32628, 32637, 32646, 32654, 32662, 32670,
+  32678, 32685, 32692, 32699, 32705, 32711, 32717, 32722,
+  32727, 32732, 32736, 32740, 32744, 32748, 32751, 32754,
+  32757, 32759, 32761, 32763, 32764, 32765, 32766, 32766,
+      0
+};
+
+/* quarter wave -log2(sin(x)), 8.8 fixed point, 1 entry padding */
+static const unsigned short opl_logsin[256 + 1] = {
+   2137,  1731,  1543,  1419,  1326,  1252,  1190,  1137,
+   1091,  1050,  1013,   979,   949,   920,   894,   869,
+    846,   825,   804,   785,   767,   749,   732,   717,
+    701,   687,   672,   659,   646,   633,   621,   609,
+    598,   587,   576,   566,   556,   546,   536,   527,
+    518,   509,   501,   492,   484,   476,   468,   461,
+    453,   446,   439,   432,   425,   418,   411,   405,
+    399,   392,   386,   380,   375,   369,   363,   358,
+    352,   347,   341,   336,   331,   326,   321,   316,
+    311,   307,   302,   297,   293,   289,   284,   280,
+    276,   271,   267,   263,   259,   255,   251,   248,
+    244,   240,   236,   233,   229,   226,   222,   219,
+    215,   212,   209,   205,   202,   199,   196,   193,
+    190,   187,   184,   181,   178,   175,   172,   169,
+    167,   164,   161,   159,   156,   153,   151,   148,
+    146,   143,   141,   138,   136,   134,   131,   129,
+    127,   125,   122,   120,   118,   116,   114,   112,
+    110,   108,   106,   104,   102,   100,    98,    96,
+     94,    92,    91,    89,    87,    85,    83,    82,
+     80,    78,    77,    75,    74,    72,    70,    69,
+     67,    66,    64,    63,    62,    60,    59,    57,
+     56,    55,    53,    52,    51,    49,    48,    47,
+     46,    45,    43,    42,    41,    40,    39,    38,
+     37,    36,    35,    34,    33,    32,    31,    30,
+     29,    28,    27,    26,    25,    24,    23,    23,
+     22,    21,    20,    20,    19,    18,    17,    17,
+     16,    15,    15,    14,    13,    13,    12,    12,
+     11,    10,    10,     9,     9,     8,     8,     7,
+      7,     7,     6,     6,     5,     5,     5,     4,
+      4,     4,     3,     3,     3,     2,     2,     2,
+      2,     1,     1,     1,     1,     1,     1,     1,
+      0,     0,     0,     0,     0,     0,     0,     0,
+      0
+};
+
+/* 2^((255 - x) / 256), scaled by 1024, 1 entry padding */
+static const unsigned short opl_exp[256 + 1] = {
+   2042,  2037,  2031,  2026,  2020,  2015,  2010,  2004,
+   1999,  1993,  1988,  1983,  1977,  1972,  1966,  1961,
+   1956,  1951,  1945,  1940,  1935,  1930,  1924,  1919,
+   1914,  1909,  1904,  1898,  1893,  1888,  1883,  1878,
+   1873,  1868,  1863,  1858,  1853,  1848,  1843,  1838,
+   1833,  1828,  1823,  1818,  1813,  1808,  1803,  1798,
+   1794,  1789,  1784,  1779,  1774,  1769,  1765,  1760,
+   1755,  1750,  1746,  1741,  1736,  1732,  1727,  1722,
+   1717,  1713,  1708,  1704,  1699,  1694,  1690,  1685,
+   1681,  1676,  1672,  1667,  1663,  1658,  1654,  1649,
+   1645,  1640,  1636,  1631,  1627,  1623,  1618,  1614,
+   1609,  1605,  1601,  1596,  1592,  1588,  1584,  1579,
+   1575,  1571,  1566,  1562,  1558,  1554,  1550,  1545,
+   1541,  1537,  1533,  1529,  1525,  1520,  1516,  1512,
+   1508,  1504,  1500,  1496,  1492,  1488,  1484,  1480,
+   1476,  1472,  1468,  1464,  1460,  1456,  1452,  1448,
+   1444,  1440,  1436,  1433,  1429,  1425,  1421,  1417,
+   1413,  1409,  1406,  1402,  1398,  1394,  1391,  1387,
+   1383,  1379,  1376,  1372,  1368,  1364,  1361,  1357,
+   1353,  1350,  1346,  1342,  1339,  1335,  1332,  1328,
+   1324,  1321,  1317,  1314,  1310,  1307,  1303,  1300,
+   1296,  1292,  1289,  1286,  1282,  1279,  1275,  1272,
+   1268,  1265,  1261,  1258,  1255,  1251,  1248,  1244,
+   1241,  1238,  1234,  1231,  1228,  1224,  1221,  1218,
+   1214,  1211,  1208,  1205,  1201,  1198,  1195,  1192,
+   1188,  1185,  1182,  1179,  1176,  1172,  1169,  1166,
+   1163,  1160,  1157,  1154,  1150,  1147,  1144,  1141,
+   1138,  1135,  1132,  1129,  1126,  1123,  1120,  1117,
+   1114,  1111,  1108,  1105,  1102,  1099,  1096,  1093,
+   1090,  1087,  1084,  1081,  1078,  1075,  1072,  1069,
+   1066,  1064,  1061,  1058,  1055,  1052,  1049,  1046,
+   1044,  1041,  1038,  1035,  1032,  1030,  1027,  1024,
+      0
+};
+
+/* 4 bit register sustain level -> envelope attenuation */
+static const unsigned short opl_sustain[16] = {
+      0,    16,    32,    48,    64,    80,    96,   112,
+    128,   144,   160,   176,   192,   208,   224,   496
+};
+
+/* envelope rate -> log2 of the samples between two updates */
+static const unsigned char opl_eg_shift[64] = {
+  12, 12, 12, 12, 11, 11, 11, 11, 10, 10, 10, 10,  9,  9,
+   9,  9,  8,  8,  8,  8,  7,  7,  7,  7,  6,  6,  6,  6,
+   5,  5,  5,  5,  4,  4,  4,  4,  3,  3,  3,  3,  2,  2,
+   2,  2,  1,  1,  1,  1,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0
+};
+
+/* envelope rate -> increments [rate * 8 + (update & 7)] */
+static const unsigned char opl_eg_inc[64 * 8] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1,
+  0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1,
+  1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+  0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1,
+  1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+  1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1,
+  1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1,
+  0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1,
+  0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1,
+  0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1,
+  0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1,
+  0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+  0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1,
+  1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1,
+  0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1,
+  0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1,
+  1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1,
+  0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1,
+  1, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+  0, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1,
+  1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1,
+  1, 1, 0, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 1,
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, 2,
+  1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 2, 2, 1, 2, 2, 2, 2, 2,
+  2, 2, 2, 2, 2, 2, 2, 2, 2, 4, 2, 2, 2, 4, 2, 4, 2, 4,
+  2, 4, 2, 4, 2, 4, 4, 4, 2, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+  4, 4, 4, 4, 4, 4, 4, 4
+};
+
+/* 2^(-x / 32) for the low 5 bits of an envelope attenuation, scaled by 2^32 */
+static const unsigned int opl_eg_level[32] = {
+  4294967295, 4202935003, 4112874773, 4024744348,
+  3938502376, 3854108391, 3771522796, 3690706840,
+  3611622603, 3534232978, 3458501653, 3384393094,
+  3311872529, 3240905930, 3171459999, 3103502151,
+  3037000500, 2971923842, 2908241642, 2845924021,
+  2784941738, 2725266179, 2666869345, 2609723834,
+  2553802834, 2499080105, 2445529972, 2393127307,
+  2341847524, 2291666561, 2242560872, 2194507417
+};
+
+/* tremolo attenuation per LFO step, 0.1875 dB units */
+static const unsigned char opl_tremolo[210] = {
+      0,     0,     0,     0,     1,     1,     1,     1,
+      2,     2,     2,     2,     3,     3,     3,     3,
+      4,     4,     4,     4,     5,     5,     5,     5,
+      6,     6,     6,     6,     7,     7,     7,     7,
+      8,     8,     8,     8,     9,     9,     9,     9,
+     10,    10,    10,    10,    11,    11,    11,    11,
+     12,    12,    12,    12,    13,    13,    13,    13,
+     14,    14,    14,    14,    15,    15,    15,    15,
+     16,    16,    16,    16,    17,    17,    17,    17,
+     18,    18,    18,    18,    19,    19,    19,    19,
+     20,    20,    20,    20,    21,    21,    21,    21,
+     22,    22,    22,    22,    23,    23,    23,    23,
+     24,    24,    24,    24,    25,    25,    25,    25,
+     26,    26,    26,    25,    25,    25,    25,    24,
+     24,    24,    24,    23,    23,    23,    23,    22,
+     22,    22,    22,    21,    21,    21,    21,    20,
+     20,    20,    20,    19,    19,    19,    19,    18,
+     18,    18,    18,    17,    17,    17,    17,    16,
+     16,    16,    16,    15,    15,    15,    15,    14,
+     14,    14,    14,    13,    13,    13,    13,    12,
+     12,    12,    12,    11,    11,    11,    11,    10,
+     10,    10,    10,     9,     9,     9,     9,     8,
+      8,     8,     8,     7,     7,     7,     7,     6,
+      6,     6,     6,     5,     5,     5,     5,     4,
+      4,     4,     4,     3,     3,     3,     3,     2,
+      2,     2,     2,     1,     1,     1,     1,     0,
+      0,     0
+};
+
+/* vibrato F-number offset [LFO step * 8 + (F-number >> 7)] */
+static const signed char opl_vibrato[8 * 8] = {
+      0,     0,     0,     0,     0,     0,     0,     0,
+      0,     0,     1,     1,     2,     2,     3,     3,
+      0,     1,     2,     3,     4,     5,     6,     7,
+      0,     0,     1,     1,     2,     2,     3,     3,
+      0,     0,     0,     0,     0,     0,     0,     0,
+      0,     0,    -1,    -1,    -2,    -2,    -3,    -3,
+      0,    -1,    -2,    -3,    -4,    -5,    -6,    -7,
+      0,     0,    -1,    -1,    -2,    -2,    -3,    -3
+};
+
+#endif